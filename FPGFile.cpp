@@ -0,0 +1,306 @@
+#include "FPGFile.h"
+#include "MapTrace.h"
+#include "GzipUtils.h"
+#include "MapStructures.h"
+#include <QDebug>
+#include <QtEndian>
+#include <QtConcurrent>
+#include <zlib.h>
+#include <functional>
+#include <limits>
+#include <cstring>
+
+static_assert(sizeof(FPG_CHUNK) == FPGFile::ChunkHeaderSize, "FPG_CHUNK debe ocupar 64 bytes");
+
+// Lado máximo que admite QImage
+static const int MaxImageSide = 32767;
+
+bool FPGFile::fail(ParseError *error, qint64 offset, const QString &reason) {
+    if (error) {
+        error->offset = offset;
+        error->reason = reason;
+    }
+    close();
+    return false;
+}
+
+bool FPGFile::open(const QString &filename, ParseError *error,
+                   const std::atomic<bool> *cancel, const std::function<void(int)> &progress) {
+    MAP_TRACE_SPAN(lcLoad, "FPGFile::open");
+    close();
+
+    file.setFileName(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(error, -1, QString("No se pudo abrir: %1").arg(file.errorString()));
+
+    size = file.size();
+    data = size > 0 ? file.map(0, size) : nullptr;
+    if (!data && size > 0) {
+        // Sin mapeo (p. ej. recursos Qt): una única lectura
+        inflated = file.readAll();
+        data = reinterpret_cast<const uchar*>(inflated.constData());
+        size = inflated.size();
+    }
+    if (!data)
+        return fail(error, -1, "Archivo FPG vacío");
+
+    // FPG comprimido con gzip: se descomprime una vez y el mapeo se libera.
+    // Es la parte lenta: se lleva hasta el 80% del progreso.
+    int inflateShare = 0;
+    if (isGzipData(reinterpret_cast<const char*>(data), size)) {
+        inflateShare = 80;
+        QByteArray decompressed;
+        bool ok = gzipDecompress(reinterpret_cast<const char*>(data), size, &decompressed, cancel,
+                                 [&](int percent) { if (progress) progress(percent * inflateShare / 100); });
+        close();
+        if (cancel && cancel->load())
+            return fail(error, -1, "Cancelado");
+        if (!ok)
+            return fail(error, -1, "Datos gzip corruptos o truncados");
+
+        inflated = decompressed;
+        data = reinterpret_cast<const uchar*>(inflated.constData());
+        size = inflated.size();
+    }
+
+    if (size < HeaderSize)
+        return fail(error, size, "Archivo FPG demasiado pequeño");
+
+    const QString type = magic().left(3).toUpper();
+    if (type == "F32") {
+        bitsPerPixel = 32;
+    } else if (type == "F16") {
+        bitsPerPixel = 16;
+    } else if (type == "F08" || type == "FPG") {
+        bitsPerPixel = 8;
+    } else {
+        return fail(error, 0, QString("Formato .fpg inválido - se esperaba 'F32', 'F16' o 'F08', se encontró '%1'")
+                                  .arg(magic()));
+    }
+
+    if (bitsPerPixel == 8) {
+        if (size < PaletteHeaderSize)
+            return fail(error, size, "Fichero truncado: falta la paleta");
+
+        // Paleta de 6 bits por componente (0-63) a 8 bits
+        const uchar *pal = data + HeaderSize;
+        colorTable.resize(256);
+        for (int c = 0; c < 256; c++) {
+            const int r = pal[c * 3] & 63, g = pal[c * 3 + 1] & 63, b = pal[c * 3 + 2] & 63;
+            colorTable[c] = qRgba((r << 2) | (r >> 4), (g << 2) | (g >> 4), (b << 2) | (b >> 4),
+                                  c == 0 ? 0 : 255);
+        }
+    }
+
+    const std::function<void(int)> indexProgress = [&](int percent) {
+        if (progress) progress(inflateShare + percent * (100 - inflateShare) / 100);
+    };
+    if (!buildIndex(cancel, indexProgress))
+        return fail(error, -1, "Cancelado");
+    return true;
+}
+
+void FPGFile::close() {
+    if (file.isOpen()) {
+        if (data && inflated.isEmpty()) file.unmap(const_cast<uchar*>(data));
+        file.close();
+    }
+    inflated.clear();
+    data = nullptr;
+    size = 0;
+    bitsPerPixel = 32;
+    colorTable.clear();
+    index.clear();
+    stored.clear();
+    chunkIssues.clear();
+}
+
+QString FPGFile::magic() const {
+    return QString::fromLatin1(reinterpret_cast<const char*>(data), 7);
+}
+
+bool FPGFile::buildIndex(const std::atomic<bool> *cancel, const std::function<void(int)> &progress) {
+    // Cada cabecera FPG_CHUNK determina dónde empieza la siguiente:
+    // 64 bytes + puntos de control + ancho * alto * bytes por píxel.
+    // No hay límite de chunks ni de tamaño: sólo se saltan (y se anotan en
+    // issues) los que no se pueden representar o no caben en el fichero.
+    const int bytesPerPixel = bitsPerPixel / 8;
+    qint64 offset = bitsPerPixel == 8 ? PaletteHeaderSize : HeaderSize;
+    for (int walked = 0; offset + ChunkHeaderSize <= size; walked++) {
+        if ((walked & 1023) == 0) {
+            if (cancel && cancel->load()) return false;
+            progress(int(offset * 100 / size));
+        }
+
+        FPG_CHUNK chunk;
+        memcpy(&chunk, data + offset, ChunkHeaderSize);
+
+        FPGChunkInfo info;
+        info.code = qFromLittleEndian<qint32>(&chunk.code);
+        info.width = qFromLittleEndian<qint32>(&chunk.width);
+        info.height = qFromLittleEndian<qint32>(&chunk.height);
+        info.numPoints = qFromLittleEndian<qint32>(&chunk.flags);
+        info.name = QString::fromLatin1(chunk.name, qstrnlen(chunk.name, sizeof(chunk.name)));
+        info.offset = offset;
+
+        if (info.width <= 0 || info.height <= 0 || info.numPoints < 0) {
+            // Sin dimensiones válidas no se sabe dónde empieza el siguiente chunk
+            chunkIssues.append({info.code, offset,
+                                QString("Cabecera inválida (%1x%2, %3 puntos): fin de lectura")
+                                    .arg(info.width).arg(info.height).arg(info.numPoints)});
+            return true;
+        }
+
+        info.pixelOffset = offset + ChunkHeaderSize + qint64(info.numPoints) * ControlPointSize;
+        if (info.pixelOffset > size) {
+            chunkIssues.append({info.code, offset,
+                                QString("Truncado: faltan %1 bytes de puntos de control")
+                                    .arg(info.pixelOffset - size)});
+            return true;
+        }
+
+        // Se divide en vez de multiplicar: con una cabecera basura el
+        // producto ancho * alto * bytes desborda incluso en 64 bits
+        const qint64 available = size - info.pixelOffset;
+        if (info.width > available / info.height / bytesPerPixel) {
+            chunkIssues.append({info.code, offset,
+                                QString("Truncado: %1x%2 píxeles no caben en %3 bytes")
+                                    .arg(info.width).arg(info.height).arg(available)});
+            return true;
+        }
+        info.pixelBytes = qint64(info.width) * info.height * bytesPerPixel;
+        offset = info.pixelOffset + info.pixelBytes;
+        stored.append(info);
+
+        // Límite de QImage, no del formato: el chunk se salta pero se sigue
+        if (info.width > MaxImageSide || info.height > MaxImageSide ||
+            qint64(info.width) * info.height * 4 > std::numeric_limits<int>::max()) {
+            chunkIssues.append({info.code, info.offset,
+                                QString("Demasiado grande para una imagen (%1x%2): se omite")
+                                    .arg(info.width).arg(info.height)});
+            continue;
+        }
+
+        index.append(info);
+    }
+
+    if (offset < size) {
+        chunkIssues.append({-1, offset, QString("%1 bytes sobrantes al final").arg(size - offset)});
+    }
+    progress(100);
+    return true;
+}
+
+QImage FPGFile::decode(int i, bool premultiplied) const {
+    MAP_TRACE_SPAN(lcDecode, "FPGFile::decode");
+    const FPGChunkInfo &info = index[i];
+    const uchar *src = data + info.pixelOffset;
+
+    // 8 bits: se queda indexado (paleta + un byte por píxel); sólo se
+    // expande a RGBA cuando se convierte para dibujar
+    if (bitsPerPixel == 8) {
+        QImage image(info.width, info.height, QImage::Format_Indexed8);
+        if (image.isNull()) return image;
+        image.setColorTable(colorTable);
+        for (int y = 0; y < info.height; y++, src += info.width) {
+            memcpy(image.scanLine(y), src, info.width);
+        }
+        return image;
+    }
+
+    // 16 bits: RGB565 little-endian, el mismo layout que Format_RGB16
+    if (bitsPerPixel == 16) {
+        QImage image(info.width, info.height, QImage::Format_RGB16);
+        if (image.isNull()) return image;
+        const int rowBytes = info.width * 2;
+        for (int y = 0; y < info.height; y++, src += rowBytes) {
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+            memcpy(image.scanLine(y), src, rowBytes);
+#else
+            quint16 *dst = reinterpret_cast<quint16*>(image.scanLine(y));
+            for (int x = 0; x < info.width; x++) dst[x] = qFromLittleEndian<quint16>(src + x * 2);
+#endif
+        }
+        return image;
+    }
+
+    // Los píxeles del FPG son B, G, R, A en memoria: en una máquina
+    // little-endian es exactamente QImage::Format_ARGB32, así que no hace
+    // falta intercambiar canales, sólo copiar
+    QImage image(info.width, info.height,
+                 premultiplied ? QImage::Format_ARGB32_Premultiplied : QImage::Format_ARGB32);
+    if (image.isNull()) return image;
+
+    const int rowBytes = info.width * 4;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    if (!premultiplied && image.bytesPerLine() == rowBytes) {
+        memcpy(image.bits(), src, size_t(rowBytes) * info.height);
+        return image;
+    }
+    for (int y = 0; y < info.height; y++, src += rowBytes) {
+        QRgb *dst = reinterpret_cast<QRgb*>(image.scanLine(y));
+        memcpy(dst, src, rowBytes);
+        // La fila recién copiada sigue en caché; los opacos no cambian
+        if (premultiplied) {
+            for (int x = 0; x < info.width; x++) {
+                if (qAlpha(dst[x]) != 255) dst[x] = qPremultiply(dst[x]);
+            }
+        }
+    }
+#else
+    for (int y = 0; y < info.height; y++, src += rowBytes) {
+        QRgb *dst = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < info.width; x++) {
+            const uchar *p = src + x * 4;
+            const QRgb pixel = qRgba(p[2], p[1], p[0], p[3]);
+            dst[x] = premultiplied ? qPremultiply(pixel) : pixel;
+        }
+    }
+#endif
+    return image;
+}
+
+QByteArray FPGFile::headerBytes() const {
+    return QByteArray(reinterpret_cast<const char*>(data), bitsPerPixel == 8 ? PaletteHeaderSize : HeaderSize);
+}
+
+const uchar *FPGFile::chunkBytes(int i, qint64 *length) const {
+    return chunkBytes(index[i], length);
+}
+
+const uchar *FPGFile::chunkBytes(const FPGChunkInfo &info, qint64 *length) const {
+    *length = info.pixelOffset + info.pixelBytes - info.offset;
+    return data + info.offset;
+}
+
+uint32_t FPGFile::pixelChecksum(int i) const {
+    const FPGChunkInfo &info = index[i];
+    const qint64 bytes = info.pixelBytes;
+    uLong crc = crc32(0L, Z_NULL, 0);
+    // crc32 recibe uInt: los chunks enormes van por tramos
+    for (qint64 done = 0; done < bytes; ) {
+        const uInt step = uInt(qMin<qint64>(bytes - done, 1 << 30));
+        crc = crc32(crc, data + info.pixelOffset + done, step);
+        done += step;
+    }
+    return uint32_t(crc);
+}
+
+bool FPGFile::samePixels(int a, int b) const {
+    const FPGChunkInfo &first = index[a];
+    const FPGChunkInfo &second = index[b];
+    if (first.width != second.width || first.height != second.height) return false;
+    return memcmp(data + first.pixelOffset, data + second.pixelOffset, size_t(first.pixelBytes)) == 0;
+}
+
+QVector<QImage> FPGFile::decodeChunks(const QVector<int> &chunks, QImage::Format format) const {
+    // El índice ya da el offset de cada chunk: son independientes entre sí
+    std::function<QImage(const int &)> task = [this, format](const int &i) {
+        QImage image = decode(i, format == QImage::Format_ARGB32_Premultiplied);
+        if (!image.isNull() && format != QImage::Format_Invalid && image.format() != format) {
+            image = image.convertToFormat(format);
+        }
+        return image;
+    };
+    return QtConcurrent::blockingMapped<QVector<QImage>>(chunks, task);
+}
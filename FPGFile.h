@@ -0,0 +1,122 @@
+#ifndef FPGFILE_H
+#define FPGFILE_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include "ParseError.h"
+
+// Chunk de un FPG localizado en el primer recorrido de cabeceras
+struct FPGChunkInfo {
+    int32_t code = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t numPoints = 0;      // Puntos de control (campo flags)
+    QString name;
+    qint64 offset = 0;          // Cabecera FPG_CHUNK
+    qint64 pixelOffset = 0;     // Primer byte de píxeles
+    qint64 pixelBytes = 0;      // Ya comprobado contra el tamaño del fichero
+};
+
+// Chunk que no se pudo indexar (o resto del fichero que no es un chunk)
+struct FPGChunkIssue {
+    int32_t code;               // -1 si no hay cabecera
+    qint64 offset;
+    QString reason;
+
+    QString toString() const {
+        return code < 0 ? QString("offset %1: %2").arg(offset).arg(reason)
+                        : QString("código %1, offset %2: %3").arg(code).arg(offset).arg(reason);
+    }
+};
+
+// Lector de FPG de BennuGD2 sobre los bytes del fichero (mapeado o, si viene
+// en gzip, descomprimido una vez). Admite 32 bits (F32), 16 bits RGB565 (F16)
+// y 8 bits con paleta (F08 y los FPG de DIV que lee M3D_crear_thumbs). open() recorre las cabeceras con aritmética
+// de punteros y deja un índice de chunks; decode() construye la imagen de un
+// chunk leyendo los píxeles directamente de esos bytes, sin copias intermedias.
+class FPGFile {
+public:
+    FPGFile() = default;
+    ~FPGFile() { close(); }
+
+    FPGFile(const FPGFile &) = delete;
+    FPGFile &operator=(const FPGFile &) = delete;
+
+    // progress recibe 0-100 (descompresión y recorrido de cabeceras); si
+    // cancel pasa a true se devuelve false sin índice
+    bool open(const QString &filename, ParseError *error = nullptr,
+              const std::atomic<bool> *cancel = nullptr,
+              const std::function<void(int)> &progress = nullptr);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+
+    QString magic() const;
+    int depth() const { return bitsPerPixel; }     // 8, 16 o 32
+
+    // Paleta de los FPG de 8 bits ya en RGB de 8 bits por canal (el fichero
+    // la guarda en 6 bits, como el DAC de DIV). El índice 0 es transparente.
+    const QVector<QRgb> &palette() const { return colorTable; }
+    const QVector<FPGChunkInfo> &chunks() const { return index; }
+    int chunkCount() const { return index.size(); }
+
+    // Todos los chunks con cabecera y tamaño correctos, también los que
+    // chunks() omite por no caber en una QImage: es lo que se reempaqueta
+    const QVector<FPGChunkInfo> &storedChunks() const { return stored; }
+
+    // Chunks omitidos durante el recorrido, con su código y offset
+    const QVector<FPGChunkIssue> &issues() const { return chunkIssues; }
+
+    // Imagen del chunk i con su propio almacenamiento; nula si falla.
+    // El formato es el nativo del FPG: Format_Indexed8 con la paleta en 8 bits
+    // (un byte por píxel), Format_RGB16 en 16 bits y Format_ARGB32 en 32 bits.
+    // Con premultiplied los de 32 bits salen en Format_ARGB32_Premultiplied,
+    // premultiplicados al copiar cada fila (sin un segundo buffer).
+    QImage decode(int i, bool premultiplied = false) const;
+
+    // Bytes tal cual del fichero: cabecera (con la paleta en 8 bits) y cada
+    // chunk completo (cabecera, puntos de control y píxeles)
+    QByteArray headerBytes() const;
+    const uchar *chunkBytes(int i, qint64 *length) const;
+    const uchar *chunkBytes(const FPGChunkInfo &info, qint64 *length) const;
+
+    // CRC32 de los píxeles del chunk (sin decodificar) y comparación exacta
+    // de dimensiones y píxeles entre dos chunks
+    uint32_t pixelChecksum(int i) const;
+    bool samePixels(int a, int b) const;
+
+    // Los chunks indicados en paralelo en el pool de hilos global, en el mismo
+    // orden. format permite dejar hecha también la conversión (p. ej. al
+    // formato premultiplicado que usa QPixmap) fuera del hilo de la GUI;
+    // Format_Invalid conserva el formato nativo.
+    QVector<QImage> decodeChunks(const QVector<int> &chunks,
+                                 QImage::Format format = QImage::Format_Invalid) const;
+
+    static const int HeaderSize = 8;            // magic "f32\x1a\x0d\x0a\x00" + versión
+    static const int PaletteHeaderSize = 8 + 768 + 576;     // + paleta y gamas (FPG_header)
+    static const int ChunkHeaderSize = 64;      // FPG_CHUNK
+    static const int ControlPointSize = 4;      // int16 x, y
+
+private:
+    bool fail(ParseError *error, qint64 offset, const QString &reason);
+    bool buildIndex(const std::atomic<bool> *cancel, const std::function<void(int)> &progress);
+
+    QFile file;
+    QByteArray inflated;              // Contenido descomprimido si el FPG venía en gzip
+    const uchar *data = nullptr;
+    qint64 size = 0;
+
+    int bitsPerPixel = 32;
+    QVector<QRgb> colorTable;
+
+    QVector<FPGChunkInfo> index;
+    QVector<FPGChunkInfo> stored;
+    QVector<FPGChunkIssue> chunkIssues;
+};
+
+#endif // FPGFILE_H
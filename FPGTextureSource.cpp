@@ -0,0 +1,211 @@
+#include "FPGTextureSource.h"
+#include "MapTrace.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QtConcurrent>
+#include <functional>
+#include <numeric>
+
+static std::atomic<quint64> nextSerial{1};
+
+FPGTextureSource::FPGTextureSource(qint64 memoryBudget) : serial(nextSerial++) {
+    cache.setMaxCost(int(qMax<qint64>(memoryBudget / 1024, 1)));
+}
+
+bool FPGTextureSource::open(const QString &filename, ParseError *error,
+                            const std::atomic<bool> *cancel, const std::function<void(int)> &progress) {
+    MAP_TRACE_SPAN(lcLoad, "FPGTextureSource::open");
+    QMutexLocker locker(&mutex);
+    cache.clear();
+    path = filename;
+    // La descompresión y el recorrido de cabeceras informan y se pueden
+    // cancelar por el camino
+    bool ok = fpg.open(filename, error, cancel, progress);
+
+    // Hasta que findDuplicates termine cada chunk es su propio canónico
+    canonical.resize(fpg.chunkCount());
+    std::iota(canonical.begin(), canonical.end(), 0);
+    dedup = DedupStats();
+    thumbnails.reset(fpg.chunkCount());
+    if (cancel && cancel->load()) return false;
+
+    // Miniaturas de una apertura anterior: la lista se llena sin decodificar
+    if (ok) thumbnails.load(thumbnailCachePath(filename), thumbnailKey());
+    return ok;
+}
+
+void FPGTextureSource::findDuplicates(const std::atomic<bool> *cancel, const std::function<void(int)> &progress) {
+    MAP_TRACE_SPAN(lcLoad, "FPGTextureSource::findDuplicates");
+    const int count = fpg.chunkCount();
+    QVector<int> found(count);
+    std::iota(found.begin(), found.end(), 0);
+    DedupStats stats;
+
+    // CRC de los píxeles en paralelo sobre los bytes del FPG (sin decodificar);
+    // las coincidencias se confirman comparando los bytes
+    QVector<int> chunkIndices(count);
+    std::iota(chunkIndices.begin(), chunkIndices.end(), 0);
+    std::atomic<int> done{0};
+    std::function<uint32_t(const int &)> checksum = [&](const int &chunk) -> uint32_t {
+        if (cancel && cancel->load()) return 0;
+        const uint32_t crc = fpg.pixelChecksum(chunk);
+        if (progress) progress(++done * 100 / count);
+        return crc;
+    };
+    const QVector<uint32_t> checksums = QtConcurrent::blockingMapped<QVector<uint32_t>>(chunkIndices, checksum);
+    if (cancel && cancel->load()) return;
+
+    QHash<uint32_t, QVector<int>> firstByChecksum;
+    for (int chunk = 0; chunk < count; chunk++) {
+        QVector<int> &candidates = firstByChecksum[checksums[chunk]];
+        for (int first : candidates) {
+            if (fpg.samePixels(first, chunk)) {
+                found[chunk] = first;
+                break;
+            }
+        }
+        if (found[chunk] == chunk) {
+            candidates.append(chunk);
+        } else {
+            const FPGChunkInfo &info = fpg.chunks()[chunk];
+            stats.duplicates++;
+            stats.bytesSaved += info.pixelBytes;
+        }
+    }
+
+    // La GUI puede estar pidiendo miniaturas mientras tanto
+    QMutexLocker locker(&mutex);
+    canonical = found;
+    dedup = stats;
+}
+
+int FPGTextureSource::canonicalChunk(int chunk) const {
+    QMutexLocker locker(&mutex);
+    return canonical[chunk];
+}
+
+FPGTextureSource::DedupStats FPGTextureSource::dedupStats() const {
+    QMutexLocker locker(&mutex);
+    return dedup;
+}
+
+int FPGTextureSource::costOf(const QImage &image) {
+    return int(qMax<qint64>(image.sizeInBytes() / 1024, 1));
+}
+
+QImage FPGTextureSource::image(int chunk) {
+    if (chunk < 0 || chunk >= fpg.chunkCount()) return QImage();
+
+    {
+        QMutexLocker locker(&mutex);
+        chunk = canonical[chunk];
+        if (QImage *cached = cache.object(chunk)) return *cached;
+    }
+
+    // La decodificación va fuera del cerrojo para que otros hilos puedan
+    // decodificar otras texturas a la vez; los bytes del FPG son de solo lectura
+    // Las de 32 bits salen ya premultiplicadas: una sola reserva por textura
+    QImage image = fpg.decode(chunk, true);
+    if (image.isNull()) return image;
+
+    // QCache no guarda objetos más caros que el presupuesto: se devuelven
+    // igualmente, pero no desplazan al resto
+    QMutexLocker locker(&mutex);
+    const int cost = costOf(image);
+    if (cost <= cache.maxCost()) cache.insert(chunk, new QImage(image), cost);
+    return image;
+}
+
+void FPGTextureSource::setMemoryBudget(qint64 bytes) {
+    QMutexLocker locker(&mutex);
+    cache.setMaxCost(int(qMax<qint64>(bytes / 1024, 1)));
+}
+
+qint64 FPGTextureSource::memoryBudget() const {
+    QMutexLocker locker(&mutex);
+    return qint64(cache.maxCost()) * 1024;
+}
+
+qint64 FPGTextureSource::cachedBytes() const {
+    QMutexLocker locker(&mutex);
+    return qint64(cache.totalCost()) * 1024;
+}
+
+QImage FPGTextureSource::thumbnail(int chunk, int size) {
+    if (chunk < 0 || chunk >= fpg.chunkCount()) return QImage();
+    const int first = canonicalChunk(chunk);
+    if (!thumbnails.contains(first)) thumbnails.build(first, image(first));
+    if (first != chunk && !thumbnails.contains(chunk)) thumbnails.share(chunk, first);
+    return thumbnails.thumbnail(chunk, size);
+}
+
+bool FPGTextureSource::hasThumbnail(int chunk) const {
+    if (chunk < 0 || chunk >= fpg.chunkCount()) return false;
+    return thumbnails.contains(chunk) || thumbnails.contains(canonicalChunk(chunk));
+}
+
+void FPGTextureSource::buildThumbnails(const std::atomic<bool> *cancel, const std::function<void(int)> &progress,
+                                       const std::function<void(int)> &batchReady) {
+    MAP_TRACE_SPAN(lcDecode, "FPGTextureSource::buildThumbnails");
+    if (thumbnails.isComplete()) return;
+
+    // Se decodifica directamente del FPG, sin pasar por la caché LRU: recorrer
+    // todo el paquete expulsaría las texturas que se están usando. Va por
+    // tandas para no tener todas las imágenes completas en memoria a la vez.
+    const int count = fpg.chunkCount();
+    const int batchSize = qMax(1, QThreadPool::globalInstance()->maxThreadCount()) * 8;
+    QVector<int> firsts;
+    {
+        QMutexLocker locker(&mutex);
+        firsts = canonical;
+    }
+    QVector<int> batch;
+    for (int start = 0; start < count && !(cancel && cancel->load()); start += batchSize) {
+        const int end = qMin(count, start + batchSize);
+        batch.clear();
+        for (int chunk = start; chunk < end; chunk++) {
+            if (firsts[chunk] == chunk && !thumbnails.contains(chunk)) batch.append(chunk);
+        }
+
+        const QVector<QImage> images = fpg.decodeChunks(batch);
+        QVector<int> positions(batch.size());
+        std::iota(positions.begin(), positions.end(), 0);
+        std::function<void(const int &)> build = [&](const int &i) {
+            thumbnails.build(batch[i], images[i]);
+        };
+        QtConcurrent::blockingMap(positions, build);
+
+        // Los duplicados reutilizan la pirámide del primero, que siempre está
+        // en esta tanda o en una anterior
+        for (int chunk = start; chunk < end; chunk++) {
+            if (firsts[chunk] != chunk) thumbnails.share(chunk, firsts[chunk]);
+        }
+
+        if (progress) progress(end * 100 / count);
+        if (batchReady) batchReady(end);
+    }
+
+    if (!(cancel && cancel->load())) thumbnails.save(thumbnailCachePath(path), thumbnailKey());
+}
+
+QString FPGTextureSource::thumbnailCachePath(const QString &fpgFile) {
+    const QByteArray hash = QCryptographicHash::hash(QFileInfo(fpgFile).absoluteFilePath().toUtf8(),
+                                                     QCryptographicHash::Sha1).toHex();
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation))
+        .filePath("thumbnails/" + QString::fromLatin1(hash) + ".fpgthumbs");
+}
+
+ThumbnailStore::SourceKey FPGTextureSource::thumbnailKey() const {
+    ThumbnailStore::SourceKey key;
+    QFileInfo info(path);
+    key.size = info.size();
+    key.modified = info.lastModified().toMSecsSinceEpoch();
+    key.codes.reserve(fpg.chunkCount());
+    for (const FPGChunkInfo &chunk : fpg.chunks()) key.codes.append(chunk.code);
+    return key;
+}
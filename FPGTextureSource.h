@@ -0,0 +1,105 @@
+#ifndef FPGTEXTURESOURCE_H
+#define FPGTEXTURESOURCE_H
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <functional>
+#include "FPGFile.h"
+#include "ThumbnailStore.h"
+
+// FPG abierto y compartido por todas las TextureEntry que salen de él.
+// Como CrearMapperThumb en divmap3d, cada textura se lee de su offset sólo
+// cuando alguien la pide; las imágenes decodificadas se guardan en una caché
+// LRU limitada por memoria. Se puede usar desde varios hilos.
+class FPGTextureSource {
+public:
+    static const qint64 DefaultMemoryBudget = 256LL * 1024 * 1024;
+
+    explicit FPGTextureSource(qint64 memoryBudget = DefaultMemoryBudget);
+
+    FPGTextureSource(const FPGTextureSource &) = delete;
+    FPGTextureSource &operator=(const FPGTextureSource &) = delete;
+
+    // progress recibe 0-100 desde hilos de trabajo. Si se cancela devuelve
+    // false y la fuente no se debe usar.
+    bool open(const QString &filename, ParseError *error = nullptr,
+              const std::atomic<bool> *cancel = nullptr,
+              const std::function<void(int)> &progress = nullptr);
+    QString fileName() const { return path; }
+
+    // Identificador único de esta fuente (para claves de cachés de la GUI)
+    quint64 id() const { return serial; }
+
+    // Índice de chunks; no cambia después de open()
+    const QVector<FPGChunkInfo> &chunks() const { return fpg.chunks(); }
+    const QVector<FPGChunkIssue> &issues() const { return fpg.issues(); }
+    int depth() const { return fpg.depth(); }
+    QByteArray headerBytes() const { return fpg.headerBytes(); }
+    const uchar *chunkBytes(int chunk, qint64 *length) const { return fpg.chunkBytes(chunk, length); }
+
+    // Chunks con los mismos píxeles (mismas dimensiones y bytes) comparten
+    // una sola imagen y una sola pirámide de miniaturas: la del primero
+    int canonicalChunk(int chunk) const;
+
+    struct DedupStats {
+        int duplicates = 0;         // Chunks que reutilizan la imagen de otro
+        qint64 bytesSaved = 0;      // Memoria de imagen que no se duplica
+    };
+    DedupStats dedupStats() const;
+
+    // Busca los duplicados (CRC en paralelo y comparación de bytes). Tras
+    // open() cada chunk es su propio canónico; esto se lanza después, en
+    // segundo plano, mientras la lista de texturas ya se puede usar.
+    void findDuplicates(const std::atomic<bool> *cancel = nullptr,
+                        const std::function<void(int)> &progress = nullptr);
+
+    // Imagen completa del chunk. Se decodifica en el primer acceso o si se
+    // expulsó de la caché. Las de 8 y 16 bits se guardan en su formato nativo
+    // (Indexed8 ocupa la cuarta parte que RGBA) y se expanden al dibujarlas;
+    // las de 32 bits ya en ARGB32_Premultiplied, el formato de QPixmap.
+    QImage image(int chunk);
+
+    // Bytes máximos de imágenes completas retenidas; al reducirlo se expulsan
+    // las usadas hace más tiempo
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const;
+    qint64 cachedBytes() const;
+
+    // Miniatura de chunk que cabe en size x size. Si su pirámide aún no está
+    // hecha se construye en el momento (sólo la de ese chunk).
+    QImage thumbnail(int chunk, int size);
+    bool hasThumbnail(int chunk) const;     // Si thumbnail() no tendría que decodificar
+
+    // Pirámides de todos los chunks en paralelo; pensado para lanzarse en
+    // segundo plano justo después de open(). Si la caché de disco ya las tenía
+    // no hay nada que hacer; si no, al terminar se guardan en ella. Va por
+    // tandas de chunks consecutivos: batchReady recibe cuántos chunks (desde
+    // el primero) tienen ya su miniatura.
+    void buildThumbnails(const std::atomic<bool> *cancel = nullptr,
+                         const std::function<void(int)> &progress = nullptr,
+                         const std::function<void(int)> &batchReady = nullptr);
+    bool thumbnailsReady() const { return thumbnails.isComplete(); }
+
+    // Fichero de la caché de miniaturas de un FPG (en CacheLocation)
+    static QString thumbnailCachePath(const QString &fpgFile);
+
+private:
+    static int costOf(const QImage &image);     // En KiB: QCache usa int
+    ThumbnailStore::SourceKey thumbnailKey() const;
+
+    FPGFile fpg;
+    QString path;
+    quint64 serial;
+    ThumbnailStore thumbnails;
+
+    mutable QMutex mutex;               // También protege canonical y dedup
+    QVector<int> canonical;
+    DedupStats dedup;
+
+    QCache<int, QImage> cache;
+};
+
+#endif // FPGTEXTURESOURCE_H
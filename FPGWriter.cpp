@@ -0,0 +1,95 @@
+#include "FPGWriter.h"
+#include "FPGFile.h"
+#include "FPGTextureSource.h"
+#include "GzipUtils.h"
+#include "MapStructures.h"
+#include <QSaveFile>
+#include <QtEndian>
+#include <limits>
+
+bool FPGWriter::acceptHeader(const QByteArray &header, int depth) {
+    // Los chunks no llevan la profundidad: mezclar FPG distintos (o paletas
+    // distintas en 8 bits) daría un fichero corrupto
+    if (bitsPerPixel == 0) {
+        headerData = header;
+        bitsPerPixel = depth;
+        return true;
+    }
+    return depth == bitsPerPixel && header.mid(FPGFile::HeaderSize) == headerData.mid(FPGFile::HeaderSize);
+}
+
+bool FPGWriter::append(const uchar *bytes, qint64 length) {
+    if (length > std::numeric_limits<int>::max() - body.size()) return false;
+    body.append(reinterpret_cast<const char*>(bytes), int(length));
+    chunks++;
+    return true;
+}
+
+bool FPGWriter::addFile(const FPGFile &fpg) {
+    if (!acceptHeader(fpg.headerBytes(), fpg.depth())) return false;
+
+    // storedChunks(), no chunks(): el límite de QImage no importa al copiar
+    for (const FPGChunkInfo &info : fpg.storedChunks()) {
+        qint64 length;
+        const uchar *bytes = fpg.chunkBytes(info, &length);
+        if (!append(bytes, length)) return false;
+    }
+    return true;
+}
+
+bool FPGWriter::addTextures(const QVector<TextureEntry> &textures) {
+    // Primero se comprueban todos los orígenes para no dejar la mitad añadida
+    QByteArray header = headerData;
+    int depth = bitsPerPixel;
+    for (const TextureEntry &texture : textures) {
+        if (texture.isNull()) continue;
+        const QByteArray sourceHeader = texture.source->headerBytes();
+        if (depth == 0) {
+            header = sourceHeader;
+            depth = texture.source->depth();
+        } else if (texture.source->depth() != depth
+                   || sourceHeader.mid(FPGFile::HeaderSize) != header.mid(FPGFile::HeaderSize)) {
+            return false;
+        }
+    }
+    if (depth == 0) return true;            // Ninguna textura con píxeles
+    acceptHeader(header, depth);
+
+    for (const TextureEntry &texture : textures) {
+        if (texture.isNull()) continue;
+        qint64 length;
+        const uchar *bytes = texture.source->chunkBytes(texture.chunk, &length);
+
+        // Copia del chunk con el código que tiene ahora en el mapa
+        QByteArray chunk(reinterpret_cast<const char*>(bytes), int(length));
+        qToLittleEndian<qint32>(qint32(texture.id), chunk.data());
+        if (!append(reinterpret_cast<const uchar*>(chunk.constData()), chunk.size())) return false;
+    }
+    return true;
+}
+
+bool FPGWriter::save(const QString &filename, bool compressed, const std::atomic<bool> *cancel) const {
+    if (headerData.isEmpty()) return false;     // Sin addFile no hay profundidad
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    bool ok;
+    if (compressed) {
+        // Un miembro gzip por bloque, comprimidos a la vez en todos los núcleos
+        QByteArray image;
+        image.reserve(int(size()));
+        image.append(headerData);
+        image.append(body);
+        const QByteArray gz = gzipCompressParallel(image.constData(), image.size(), BlockSize);
+        ok = !gz.isEmpty() && file.write(gz) == gz.size();
+    } else {
+        ok = file.write(headerData) == headerData.size() && file.write(body) == body.size();
+    }
+
+    if (!ok || (cancel && cancel->load())) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
@@ -0,0 +1,53 @@
+#ifndef FPGWRITER_H
+#define FPGWRITER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <cstdint>
+
+class FPGFile;
+struct TextureEntry;
+
+// Escritor de FPG de BennuGD2 para reempaquetar: los chunks de uno o varios
+// FPG se copian tal cual (cabecera FPG_CHUNK, puntos de control y píxeles) en
+// un único buffer; save() lo escribe tal cual o en gzip comprimiendo bloques
+// independientes en paralelo. Nunca se reconvierten píxeles, así que la
+// profundidad del fichero es siempre la de los chunks.
+class FPGWriter {
+public:
+    FPGWriter() = default;
+
+    // Todo el contenido de fpg, también los chunks que no caben en una
+    // QImage. El primer FPG fija la cabecera (profundidad y paleta); los
+    // siguientes se rechazan si no tienen la misma.
+    bool addFile(const FPGFile &fpg);
+
+    // Texturas del mapa: el chunk de cada una sale de su FPG de origen con
+    // el código actual (TextureEntry::id). Las que no tienen origen se
+    // saltan; si alguna viene de un FPG de otra profundidad o paleta no se
+    // añade ninguna.
+    bool addTextures(const QVector<TextureEntry> &textures);
+
+    int depth() const { return bitsPerPixel; }     // 0 hasta el primer addFile
+    int chunkCount() const { return chunks; }
+    qint64 size() const { return headerData.size() + body.size(); }
+
+    // compressed: gzip de varios miembros (uno por bloque de BlockSize)
+    bool save(const QString &filename, bool compressed = true,
+              const std::atomic<bool> *cancel = nullptr) const;
+
+    static const qint64 BlockSize = 4 << 20;
+
+private:
+    bool acceptHeader(const QByteArray &header, int depth);
+    bool append(const uchar *bytes, qint64 length);
+
+    QByteArray headerData;
+    QByteArray body;
+    int bitsPerPixel = 0;
+    int chunks = 0;
+};
+
+#endif // FPGWRITER_H
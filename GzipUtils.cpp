@@ -0,0 +1,132 @@
+#include "GzipUtils.h"
+#include "MapTrace.h"
+#include <QtEndian>
+#include <QtConcurrent>
+#include <functional>
+#include <zlib.h>
+#include <limits>
+
+bool isGzipData(const char *data, qint64 size) {
+    return size >= 2 && uchar(data[0]) == 0x1f && uchar(data[1]) == 0x8b;
+}
+
+QByteArray gzipCompress(const char *data, qint64 size, int level) {
+    z_stream strm = {};
+
+    // Modo gzip (+16) para que la salida sea un .gz estándar
+    if (deflateInit2(&strm, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return QByteArray();
+    }
+
+    // deflateBound da el peor caso: una sola llamada a deflate basta
+    QByteArray out(int(deflateBound(&strm, uLong(size))), Qt::Uninitialized);
+    strm.next_in = (Bytef*)data;
+    strm.avail_in = uInt(size);
+    strm.next_out = (Bytef*)out.data();
+    strm.avail_out = uInt(out.size());
+
+    int ret = deflate(&strm, Z_FINISH);
+    deflateEnd(&strm);
+    if (ret != Z_STREAM_END) {
+        return QByteArray();
+    }
+
+    out.resize(int(strm.total_out));
+    return out;
+}
+
+QByteArray gzipCompressParallel(const char *data, qint64 size, qint64 blockSize, int level) {
+    if (size <= blockSize) return gzipCompress(data, size, level);
+
+    QVector<qint64> offsets;
+    for (qint64 offset = 0; offset < size; offset += blockSize) offsets.append(offset);
+
+    std::function<QByteArray(const qint64 &)> task = [=](const qint64 &offset) {
+        return gzipCompress(data + offset, qMin(blockSize, size - offset), level);
+    };
+    const QVector<QByteArray> members = QtConcurrent::blockingMapped<QVector<QByteArray>>(offsets, task);
+
+    qint64 total = 0;
+    for (const QByteArray &member : members) {
+        if (member.isEmpty()) return QByteArray();
+        total += member.size();
+    }
+    QByteArray out;
+    out.reserve(int(total));
+    for (const QByteArray &member : members) out.append(member);
+    return out;
+}
+
+qint64 gzipSizeHint(const char *data, qint64 size) {
+    // Cabecera (10) + trailer CRC32 e ISIZE (8) como mínimo
+    if (size < 18 || !isGzipData(data, size)) return 0;
+    return qFromLittleEndian<quint32>(data + size - 4);
+}
+
+bool gzipDecompress(const char *data, qint64 size, QByteArray *out,
+                    const std::atomic<bool> *cancel, const std::function<void(int)> &progress) {
+    MAP_TRACE_SPAN(lcInflate, "gzipDecompress");
+    z_stream strm = {};
+    strm.next_in = (Bytef*)data;
+    strm.avail_in = uInt(size);
+
+    // Inicializar inflate con modo gzip (+16)
+    if (inflateInit2(&strm, 15 + 16) != Z_OK) {
+        return false;
+    }
+
+    // Con ISIZE un único miembro se descomprime en una pasada sin copias.
+    // deflate no pasa de ~1032:1: un ISIZE fuera de ese margen no es fiable
+    // (trailer truncado o dañado) y se vuelve al crecimiento por duplicación.
+    qint64 hint = gzipSizeHint(data, size);
+    if (hint < size / 1032 || hint > size * 1032 || hint > std::numeric_limits<int>::max()) hint = 0;
+    out->clear();
+    out->resize(int(hint > 0 ? hint : qMax<qint64>(size * 4, 4096)));
+
+    // La salida se entrega por tramos para poder informar y cancelar entre
+    // llamadas; con ISIZE fiable sigue sin haber ninguna copia
+    const qint64 slice = 4 << 20;
+    qint64 produced = 0;    // total_out se reinicia en cada miembro
+    int lastPercent = -1;
+    int ret;
+    for (;;) {
+        if (cancel && cancel->load()) {
+            ret = Z_DATA_ERROR;
+            break;
+        }
+        if (progress && size > 0) {
+            const int percent = int((size - strm.avail_in) * 100 / size);
+            if (percent != lastPercent) progress(lastPercent = percent);
+        }
+
+        // Agrandar el destino cuando se llena (varios miembros o ISIZE erróneo)
+        if (produced == out->size()) {
+            out->resize(out->size() * 2);
+        }
+        strm.next_out = (Bytef*)out->data() + produced;
+        strm.avail_out = uInt(qMin(out->size() - produced, slice));
+        const uInt before = strm.avail_out;
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+        produced += before - strm.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            // Siguiente miembro concatenado, como hace gzip -d
+            if (isGzipData((const char*)strm.next_in, strm.avail_in) && inflateReset(&strm) == Z_OK) {
+                continue;
+            }
+            break;
+        }
+        if (ret == Z_BUF_ERROR && strm.avail_out == 0) continue;
+        if (ret != Z_OK) break;
+    }
+
+    inflateEnd(&strm);
+    if (ret != Z_STREAM_END) {
+        out->clear();
+        return false;
+    }
+
+    out->resize(int(produced));
+    return true;
+}
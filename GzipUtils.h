@@ -0,0 +1,33 @@
+#ifndef GZIPUTILS_H
+#define GZIPUTILS_H
+
+#include <QByteArray>
+#include <atomic>
+#include <functional>
+
+// Utilidades gzip sobre zlib (mismo formato que los FPG comprimidos de BennuGD2)
+
+// true si los datos empiezan por la firma gzip 1f 8b
+bool isGzipData(const char *data, qint64 size);
+
+// Comprime en un único miembro gzip. Devuelve un array vacío si falla.
+QByteArray gzipCompress(const char *data, qint64 size, int level = -1);
+
+// Comprime en bloques independientes de blockSize bytes, en paralelo en el
+// pool de hilos global, y concatena un miembro gzip por bloque. El resultado
+// es un .gz estándar de varios miembros (gzip -d, zlib y gzipDecompress lo leen).
+QByteArray gzipCompressParallel(const char *data, qint64 size, qint64 blockSize = 4 << 20, int level = -1);
+
+// Tamaño descomprimido según el campo ISIZE del final del flujo (módulo 2^32).
+// En ficheros con varios miembros sólo cuenta el último; 0 si no hay trailer.
+qint64 gzipSizeHint(const char *data, qint64 size);
+
+// Descomprime un flujo gzip completo en out, incluidos varios miembros
+// concatenados. El destino se reserva una vez con gzipSizeHint y sólo crece
+// si el flujo resulta ser mayor. Devuelve false si está corrupto o si cancel
+// pasa a true; progress recibe 0-100 según los bytes de entrada consumidos.
+bool gzipDecompress(const char *data, qint64 size, QByteArray *out,
+                    const std::atomic<bool> *cancel = nullptr,
+                    const std::function<void(int)> &progress = nullptr);
+
+#endif // GZIPUTILS_H
@@ -0,0 +1,89 @@
+#include "MapGeometry.h"
+#include "MapTrace.h"
+#include <QHash>
+#include <algorithm>
+#include <limits>
+
+void MapGeometry::regionRing(const ModernMap &map, const std::vector<int32_t> &regionWalls,
+                             std::vector<int32_t> &ring) {
+    const int numPoints = map.points.size();
+    QHash<int32_t, int> byStart;
+    byStart.reserve(regionWalls.size());
+    for (int i = 0; i < int(regionWalls.size()); i++) {
+        byStart.insert(map.walls[regionWalls[i]].p1, i);
+    }
+
+    std::vector<bool> visited(regionWalls.size(), false);
+    for (int first = 0; first < int(regionWalls.size()); first++) {
+        int current = first;
+        while (current >= 0 && !visited[current]) {
+            visited[current] = true;
+            const ModernWall &wall = map.walls[regionWalls[current]];
+            if (wall.p1 >= 0 && wall.p1 < numPoints) ring.push_back(wall.p1);
+            current = byStart.value(wall.p2, -1);
+        }
+    }
+}
+
+MapGeometry MapGeometry::build(const ModernMap &map,
+                               const std::atomic<bool> *cancel,
+                               const std::function<void(int)> &progress) {
+    MAP_TRACE_SPAN(lcGeometry, "MapGeometry::build");
+    MapGeometry geometry;
+    const int numPoints = map.points.size();
+
+    // Calcular bounds del mapa
+    geometry.minX = std::numeric_limits<qreal>::max();
+    geometry.minY = std::numeric_limits<qreal>::max();
+    geometry.maxX = std::numeric_limits<qreal>::lowest();
+    geometry.maxY = std::numeric_limits<qreal>::lowest();
+
+    for (const ModernWall &wall : map.walls) {
+        if (wall.p1 >= 0 && wall.p1 < numPoints && wall.p2 >= 0 && wall.p2 < numPoints) {
+            const ModernPoint &p1 = map.points[wall.p1];
+            const ModernPoint &p2 = map.points[wall.p2];
+
+            geometry.minX = std::min({geometry.minX, (qreal)p1.x, (qreal)p2.x});
+            geometry.minY = std::min({geometry.minY, (qreal)p1.y, (qreal)p2.y});
+            geometry.maxX = std::max({geometry.maxX, (qreal)p1.x, (qreal)p2.x});
+            geometry.maxY = std::max({geometry.maxY, (qreal)p1.y, (qreal)p2.y});
+            geometry.valid = true;
+        }
+    }
+
+    if (!geometry.valid) return geometry;
+    if (progress) progress(10);
+
+    // Una sola pasada por las paredes las reparte entre las regiones (antes
+    // se recorrían todas las paredes por cada región)
+    const int numRegions = map.regions.size();
+    std::vector<std::vector<int32_t>> regionWalls(numRegions);
+    const int numWalls = map.walls.size();
+    for (int i = 0; i < numWalls; i++) {
+        const ModernWall &wall = map.walls[i];
+        if (wall.front_region >= 0 && wall.front_region < numRegions) {
+            regionWalls[wall.front_region].push_back(i);
+        }
+    }
+    if (cancel && cancel->load()) return MapGeometry();
+    if (progress) progress(20);
+
+    // Contorno ordenado de cada región, igual que el que guarda el .wldx
+    geometry.regionPoints.resize(numRegions);
+    std::vector<int32_t> ring;
+    for (int r = 0; r < numRegions; r++) {
+        ring.clear();
+        regionRing(map, regionWalls[r], ring);
+        std::vector<QPointF> &sectorPoints = geometry.regionPoints[r];
+        sectorPoints.reserve(ring.size());
+        for (int32_t point : ring) sectorPoints.push_back(QPointF(map.points[point].x, map.points[point].y));
+
+        if ((r & 255) == 0) {
+            if (cancel && cancel->load()) return MapGeometry();
+            if (progress) progress(20 + 80 * r / numRegions);
+        }
+    }
+
+    if (progress) progress(100);
+    return geometry;
+}
@@ -0,0 +1,33 @@
+#ifndef MAPGEOMETRY_H
+#define MAPGEOMETRY_H
+
+#include <QPointF>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "MapStructures.h"
+
+// Datos derivados de un ModernMap que drawWLDMap necesita para dibujar:
+// límites del mapa y, por cada región, el contorno de sus paredes frontales.
+// No depende de la escena, así que se puede calcular en un hilo de trabajo.
+struct MapGeometry {
+    bool valid = false;     // false si el mapa no tiene paredes dibujables
+    qreal minX = 0, minY = 0;
+    qreal maxX = 0, maxY = 0;
+
+    std::vector<std::vector<QPointF>> regionPoints;   // Coordenadas de mapa, en orden
+
+    // Índices de los puntos de una región en orden, encadenando sus paredes
+    // p2 -> p1; si tiene varios contornos se concatenan. build() y el .wldx
+    // la comparten para que el polígono sea el mismo venga de donde venga.
+    static void regionRing(const ModernMap &map, const std::vector<int32_t> &regionWalls,
+                           std::vector<int32_t> &ring);
+
+    // progress recibe valores de 0 a 100; si cancel pasa a true se devuelve
+    // una geometría inválida
+    static MapGeometry build(const ModernMap &map,
+                             const std::atomic<bool> *cancel = nullptr,
+                             const std::function<void(int)> &progress = nullptr);
+};
+
+#endif // MAPGEOMETRY_H
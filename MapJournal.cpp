@@ -0,0 +1,279 @@
+#include "MapJournal.h"
+#include <QByteArray>
+#include <QSaveFile>
+#include <zlib.h>
+#include <cstring>
+
+// Cabecera: magic + CRC y tamaño del WLD sobre el que se aplican los registros
+static const char JournalMagic[8] = {'w', 'l', 'd', 'j', '\x1a', '\x0d', '\x0a', '\x01'};
+static const int JournalHeaderSize = 8 + 4 + 4;
+
+// Registro: operación (1) + índice (4) + datos + CRC del registro (4)
+static const int RecordOverhead = 1 + 4 + 4;
+
+static int payloadSize(uint8_t op) {
+    switch (op) {
+    case MapJournal::SetPoint: return sizeof(tpoint);
+    case MapJournal::SetWall: return sizeof(twall);
+    case MapJournal::SetRegion: return sizeof(tregion);
+    case MapJournal::EraseRegion: return 0;
+    }
+    return -1;
+}
+
+// Registro completo listo para escribir
+static QByteArray encodeRecord(MapJournal::Operation op, int32_t index, const void *payload, int payloadSize) {
+    QByteArray record(RecordOverhead + payloadSize, Qt::Uninitialized);
+    char *data = record.data();
+    data[0] = char(op);
+    memcpy(data + 1, &index, 4);
+    if (payloadSize > 0) memcpy(data + 5, payload, payloadSize);
+    uint32_t crc = crc32(0L, reinterpret_cast<const Bytef*>(data), uInt(5 + payloadSize));
+    memcpy(data + 5 + payloadSize, &crc, 4);
+    return record;
+}
+
+static tpoint toLegacy(const ModernPoint &point) {
+    return {point.active, point.x, point.y, point.links};
+}
+
+static twall toLegacy(const ModernWall &wall) {
+    return {wall.active, wall.type, wall.p1, wall.p2, wall.front_region, wall.back_region,
+            wall.texture, wall.texture_top, wall.texture_bot, wall.fade};
+}
+
+static tregion toLegacy(const ModernRegion &region) {
+    return {region.active, region.type, region.floor_height, region.ceiling_height,
+            region.floor_tex, region.ceil_tex, region.fade};
+}
+
+// Registros Set* de los elementos de current que no coinciden con base.
+// baseLegacy da el registro de base tal y como queda tras los EraseRegion.
+template <typename Legacy, typename Element, typename BaseLegacy>
+static void appendChanged(QByteArray &out, int *count, MapJournal::Operation op,
+                          const std::vector<Element> &base, const std::vector<Element> &current,
+                          BaseLegacy baseLegacy) {
+    for (size_t i = 0; i < current.size(); i++) {
+        const Legacy now = toLegacy(current[i]);
+        if (i < base.size()) {
+            const Legacy before = baseLegacy(base[i]);
+            if (memcmp(&now, &before, sizeof(Legacy)) == 0) continue;
+        }
+        out += encodeRecord(op, int32_t(i), &now, sizeof(now));
+        (*count)++;
+    }
+}
+
+QString MapJournal::journalPath(const QString &mapFile) {
+    return mapFile + ".journal";
+}
+
+bool MapJournal::fileChecksum(const QString &path, uint32_t *crc, int32_t *size) {
+    QFile wld(path);
+    if (!wld.open(QIODevice::ReadOnly)) return false;
+
+    *size = int32_t(wld.size());
+    *crc = crc32(0L, Z_NULL, 0);
+    if (*size == 0) return true;
+
+    const uchar *data = wld.map(0, wld.size());
+    if (!data) return false;
+    *crc = crc32(*crc, data, uInt(*size));
+    wld.unmap(const_cast<uchar*>(data));
+    return true;
+}
+
+bool MapJournal::start(const QString &mapFile) {
+    // Vacío: las ediciones anteriores ya están en el WLD
+    return begin(mapFile, QByteArray(), 0);
+}
+
+bool MapJournal::start(const QString &mapFile, const ModernMap &base, const ModernMap &current) {
+    if (current.points.size() < base.points.size() || current.walls.size() < base.walls.size()) {
+        close();
+        return false;
+    }
+
+    QByteArray pending;
+    int count = 0;
+
+    // Las regiones sobrantes se eliminan desde el final; replay las aplica
+    // con eraseRegion, que deja en -1 las paredes que las usaban
+    const int32_t keptRegions = int32_t(current.regions.size());
+    for (int32_t i = int32_t(base.regions.size()) - 1; i >= keptRegions; i--) {
+        pending += encodeRecord(EraseRegion, i, nullptr, 0);
+        count++;
+    }
+
+    appendChanged<tpoint, ModernPoint>(pending, &count, SetPoint, base.points, current.points,
+                                       [](const ModernPoint &p) { return toLegacy(p); });
+    appendChanged<twall, ModernWall>(pending, &count, SetWall, base.walls, current.walls,
+                                     [keptRegions](const ModernWall &w) {
+        twall tw = toLegacy(w);
+        if (tw.front_region >= keptRegions) tw.front_region = -1;
+        if (tw.back_region >= keptRegions) tw.back_region = -1;
+        return tw;
+    });
+    appendChanged<tregion, ModernRegion>(pending, &count, SetRegion, base.regions, current.regions,
+                                         [](const ModernRegion &r) { return toLegacy(r); });
+
+    return begin(mapFile, pending, count);
+}
+
+bool MapJournal::begin(const QString &mapFile, const QByteArray &pending, int count) {
+    close();
+
+    uint32_t crc;
+    int32_t size;
+    if (!fileChecksum(mapFile, &crc, &size)) return false;
+
+    // El diario nuevo sustituye al anterior de golpe: un corte a medias deja
+    // uno de los dos completo, nunca un diario sin las ediciones pendientes
+    QByteArray bytes(JournalHeaderSize, Qt::Uninitialized);
+    memcpy(bytes.data(), JournalMagic, 8);
+    memcpy(bytes.data() + 8, &crc, 4);
+    memcpy(bytes.data() + 12, &size, 4);
+    bytes += pending;
+
+    QSaveFile replacement(journalPath(mapFile));
+    if (!replacement.open(QIODevice::WriteOnly) || replacement.write(bytes) != bytes.size()
+        || !replacement.commit()) {
+        return false;
+    }
+
+    file.setFileName(journalPath(mapFile));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) return false;
+
+    records = count;
+    return true;
+}
+
+void MapJournal::close() {
+    if (file.isOpen()) file.close();
+    records = 0;
+}
+
+void MapJournal::append(Operation op, int32_t index, const void *payload, int payloadSize) {
+    if (!file.isOpen()) return;
+
+    // Una única escritura sin buffer por edición: un corte deja como mucho
+    // el último registro incompleto, que replay() descarta por el CRC
+    const QByteArray record = encodeRecord(op, index, payload, payloadSize);
+    if (file.write(record) == record.size()) records++;
+}
+
+void MapJournal::recordPoint(int index, const ModernPoint &point) {
+    tpoint tp = toLegacy(point);
+    append(SetPoint, index, &tp, sizeof(tp));
+}
+
+void MapJournal::recordWall(int index, const ModernWall &wall) {
+    twall tw = toLegacy(wall);
+    append(SetWall, index, &tw, sizeof(tw));
+}
+
+void MapJournal::recordRegion(int index, const ModernRegion &region) {
+    tregion tr = toLegacy(region);
+    append(SetRegion, index, &tr, sizeof(tr));
+}
+
+void MapJournal::recordRegionErased(int index) {
+    append(EraseRegion, index, nullptr, 0);
+}
+
+int MapJournal::replay(const QString &mapFile, ModernMap &map) {
+    QFile journal(journalPath(mapFile));
+    if (!journal.open(QIODevice::ReadOnly)) return 0;
+    QByteArray bytes = journal.readAll();
+    journal.close();
+
+    if (bytes.size() < JournalHeaderSize || memcmp(bytes.constData(), JournalMagic, 8) != 0) return 0;
+
+    // El diario sólo vale para el WLD exacto sobre el que se empezó
+    uint32_t crc, baseCrc;
+    int32_t size, baseSize;
+    if (!fileChecksum(mapFile, &crc, &size)) return 0;
+    memcpy(&baseCrc, bytes.constData() + 8, 4);
+    memcpy(&baseSize, bytes.constData() + 12, 4);
+    if (crc != baseCrc || size != baseSize) return 0;
+
+    const char *data = bytes.constData();
+    int offset = JournalHeaderSize;
+    int applied = 0;
+
+    while (offset + RecordOverhead <= bytes.size()) {
+        const uint8_t op = uint8_t(data[offset]);
+        const int length = payloadSize(op);
+        if (length < 0 || offset + RecordOverhead + length > bytes.size()) break;
+
+        uint32_t storedCrc;
+        memcpy(&storedCrc, data + offset + 5 + length, 4);
+        if (crc32(0L, reinterpret_cast<const Bytef*>(data + offset), uInt(5 + length)) != storedCrc) break;
+
+        int32_t index;
+        memcpy(&index, data + offset + 1, 4);
+        const char *payload = data + offset + 5;
+
+        bool ok = true;
+        switch (op) {
+        case SetPoint: {
+            ok = index >= 0 && index <= int(map.points.size());
+            if (!ok) break;
+            tpoint tp;
+            memcpy(&tp, payload, sizeof(tp));
+            if (index == int(map.points.size())) map.points.emplace_back();
+            ModernPoint &p = map.points[index];
+            p.active = tp.active;
+            p.x = tp.x;
+            p.y = tp.y;
+            p.links = tp.links;
+            break;
+        }
+        case SetWall: {
+            ok = index >= 0 && index <= int(map.walls.size());
+            if (!ok) break;
+            twall tw;
+            memcpy(&tw, payload, sizeof(tw));
+            if (index == int(map.walls.size())) map.walls.emplace_back();
+            ModernWall &w = map.walls[index];
+            w.active = tw.active;
+            w.type = tw.type;
+            w.p1 = tw.p1;
+            w.p2 = tw.p2;
+            w.front_region = tw.front_region;
+            w.back_region = tw.back_region;
+            w.texture = tw.texture;
+            w.texture_top = tw.texture_top;
+            w.texture_bot = tw.texture_bot;
+            w.fade = tw.fade;
+            break;
+        }
+        case SetRegion: {
+            ok = index >= 0 && index <= int(map.regions.size());
+            if (!ok) break;
+            tregion tr;
+            memcpy(&tr, payload, sizeof(tr));
+            if (index == int(map.regions.size())) map.regions.emplace_back();
+            ModernRegion &r = map.regions[index];
+            r.active = tr.active;
+            r.type = tr.type;
+            r.floor_height = tr.floor_height;
+            r.ceiling_height = tr.ceil_height;
+            r.floor_tex = tr.floor_tex;
+            r.ceil_tex = tr.ceil_tex;
+            r.fade = tr.fade;
+            break;
+        }
+        case EraseRegion:
+            ok = index >= 0 && index < int(map.regions.size());
+            if (ok) map.eraseRegion(index);
+            break;
+        }
+
+        if (!ok) break;
+        offset += RecordOverhead + length;
+        applied++;
+    }
+
+    return applied;
+}
@@ -0,0 +1,66 @@
+#ifndef MAPJOURNAL_H
+#define MAPJOURNAL_H
+
+#include <QFile>
+#include <QString>
+#include <cstdint>
+#include "MapStructures.h"
+
+// Diario de ediciones de solo añadido que vive junto al WLD (mapa.wld.journal).
+// Cada edición se guarda como un registro pequeño (operación, índice, datos
+// tpoint/twall/tregion y CRC). Tras un cierre inesperado se reaplica sobre el
+// último WLD guardado; cada CompactThreshold registros el mapa se vuelve a
+// guardar entero y el diario empieza de cero.
+class MapJournal {
+public:
+    enum Operation : uint8_t {
+        SetPoint = 1,       // Sobrescribe el punto index (o lo añade si index == size)
+        SetWall = 2,        // Igual para paredes
+        SetRegion = 3,      // Igual para regiones
+        EraseRegion = 4     // Elimina la región index (ModernMap::eraseRegion)
+    };
+
+    static const int CompactThreshold = 256;
+
+    MapJournal() = default;
+    ~MapJournal() { close(); }
+
+    MapJournal(const MapJournal &) = delete;
+    MapJournal &operator=(const MapJournal &) = delete;
+
+    static QString journalPath(const QString &mapFile);
+
+    // CRC32 y tamaño del fichero tal y como está en disco
+    static bool fileChecksum(const QString &path, uint32_t *crc, int32_t *size);
+
+    // Empieza un diario vacío ligado al contenido actual de mapFile
+    bool start(const QString &mapFile);
+
+    // Igual, pero el diario nuevo ya lleva las ediciones que convierten base
+    // (lo que hay en mapFile) en current, p. ej. las hechas mientras base se
+    // guardaba. Falla si current tiene menos puntos o paredes que base.
+    bool start(const QString &mapFile, const ModernMap &base, const ModernMap &current);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+    int recordCount() const { return records; }
+    bool needsCompaction() const { return records >= CompactThreshold; }
+
+    // Reaplica sobre map las ediciones pendientes de mapFile. Devuelve el número
+    // de registros aplicados (0 si no hay diario o no corresponde a ese WLD).
+    // La lectura se detiene en el primer registro incompleto o corrupto.
+    static int replay(const QString &mapFile, ModernMap &map);
+
+    void recordPoint(int index, const ModernPoint &point);
+    void recordWall(int index, const ModernWall &wall);
+    void recordRegion(int index, const ModernRegion &region);
+    void recordRegionErased(int index);
+
+private:
+    bool begin(const QString &mapFile, const QByteArray &pending, int count);
+    void append(Operation op, int32_t index, const void *payload, int payloadSize);
+
+    QFile file;
+    int records = 0;
+};
+
+#endif // MAPJOURNAL_H
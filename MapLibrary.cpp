@@ -0,0 +1,105 @@
+#include "MapLibrary.h"
+#include "MapStructures.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QtConcurrent>
+#include <algorithm>
+#include <functional>
+
+bool MapIndexEntry::usesTexture(int32_t code) const {
+    return std::binary_search(textureCodes.begin(), textureCodes.end(), code);
+}
+
+MapIndexEntry MapLibrary::indexMap(const QString &path) {
+    MapIndexEntry entry;
+    entry.path = path;
+
+    ModernMap map;
+    ParseError error;
+    if (!map.loadFromWLD(path, &error)) {
+        entry.error = error.toString();
+        return entry;
+    }
+
+    entry.ok = true;
+    entry.numPoints = map.points.size();
+    entry.numWalls = map.walls.size();
+    entry.numRegions = map.regions.size();
+    entry.fpgName = map.fpgName;
+
+    if (!map.points.empty()) {
+        entry.minX = entry.maxX = map.points[0].x;
+        entry.minY = entry.maxY = map.points[0].y;
+        for (const ModernPoint &point : map.points) {
+            entry.minX = std::min(entry.minX, point.x);
+            entry.minY = std::min(entry.minY, point.y);
+            entry.maxX = std::max(entry.maxX, point.x);
+            entry.maxY = std::max(entry.maxY, point.y);
+        }
+    }
+
+    // Códigos de textura de paredes (media, superior, inferior) y regiones
+    std::vector<int32_t> &codes = entry.textureCodes;
+    codes.reserve(map.walls.size() * 3 + map.regions.size() * 2);
+    for (const ModernWall &wall : map.walls) {
+        codes.push_back(wall.texture);
+        codes.push_back(wall.texture_top);
+        codes.push_back(wall.texture_bot);
+    }
+    for (const ModernRegion &region : map.regions) {
+        codes.push_back(region.floor_tex);
+        codes.push_back(region.ceil_tex);
+    }
+    std::sort(codes.begin(), codes.end());
+    codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+    codes.erase(std::remove(codes.begin(), codes.end(), 0), codes.end());   // 0 = sin textura
+    codes.shrink_to_fit();
+
+    return entry;
+}
+
+int MapLibrary::scanDirectory(const QString &directory) {
+    QStringList files;
+    QDirIterator it(directory, {"*.wld", "*.WLD"}, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) files << it.next();
+    return addFiles(files);
+}
+
+int MapLibrary::addFiles(const QStringList &files) {
+    // Un mapa por tarea en el pool de hilos global; cada tarea descarta el
+    // ModernMap en cuanto tiene su entrada del índice
+    std::function<MapIndexEntry(const QString &)> task = &MapLibrary::indexMap;
+    const QList<MapIndexEntry> entries = QtConcurrent::blockingMapped<QList<MapIndexEntry>>(files, task);
+
+    int indexed = 0;
+    index.reserve(index.size() + entries.size());
+    for (const MapIndexEntry &entry : entries) {
+        if (entry.ok) indexed++;
+        index.append(entry);
+    }
+    return indexed;
+}
+
+QStringList MapLibrary::mapsUsingTexture(int32_t code) const {
+    QStringList result;
+    for (const MapIndexEntry &entry : index) {
+        if (entry.ok && entry.usesTexture(code)) result << entry.path;
+    }
+    return result;
+}
+
+QStringList MapLibrary::mapsUsingFPG(const QString &fpgName) const {
+    QStringList result;
+    for (const MapIndexEntry &entry : index) {
+        if (entry.ok && entry.fpgName.compare(fpgName, Qt::CaseInsensitive) == 0) result << entry.path;
+    }
+    return result;
+}
+
+QStringList MapLibrary::mapsLargerThan(int32_t maxWidth, int32_t maxHeight) const {
+    QStringList result;
+    for (const MapIndexEntry &entry : index) {
+        if (entry.ok && (entry.width() > maxWidth || entry.height() > maxHeight)) result << entry.path;
+    }
+    return result;
+}
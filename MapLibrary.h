@@ -0,0 +1,56 @@
+#ifndef MAPLIBRARY_H
+#define MAPLIBRARY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <cstdint>
+#include <vector>
+
+// Resumen compacto de un WLD para poder consultar una carpeta entera de
+// mapas sin volver a leer los ficheros
+struct MapIndexEntry {
+    QString path;
+    bool ok = false;
+    QString error;
+
+    int numPoints = 0;
+    int numWalls = 0;
+    int numRegions = 0;
+
+    // Bounding box de los puntos (sólo válida si numPoints > 0)
+    int32_t minX = 0, minY = 0;
+    int32_t maxX = 0, maxY = 0;
+
+    std::vector<int32_t> textureCodes;   // Ordenados y sin repetir
+    QString fpgName;                     // Nombre del FPG en la cabecera
+
+    bool usesTexture(int32_t code) const;
+    int32_t width() const { return numPoints > 0 ? maxX - minX : 0; }
+    int32_t height() const { return numPoints > 0 ? maxY - minY : 0; }
+};
+
+// Biblioteca de mapas: carga muchos WLD en paralelo con ModernMap::loadFromWLD
+// y guarda sólo su índice
+class MapLibrary {
+public:
+    // Indexa todos los .wld del directorio (y subdirectorios). Devuelve cuántos
+    // se indexaron sin errores.
+    int scanDirectory(const QString &directory);
+    int addFiles(const QStringList &files);
+    void clear() { index.clear(); }
+
+    const QVector<MapIndexEntry> &entries() const { return index; }
+
+    // Consultas sobre el índice en memoria
+    QStringList mapsUsingTexture(int32_t code) const;
+    QStringList mapsUsingFPG(const QString &fpgName) const;
+    QStringList mapsLargerThan(int32_t maxWidth, int32_t maxHeight) const;
+
+    static MapIndexEntry indexMap(const QString &path);
+
+private:
+    QVector<MapIndexEntry> index;
+};
+
+#endif // MAPLIBRARY_H
@@ -0,0 +1,315 @@
+#include "MapSidecar.h"
+#include "MapTrace.h"
+#include "MapJournal.h"
+#include <QFileInfo>
+#include <QDir>
+#include <QHash>
+#include <QSaveFile>
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+
+static const char SidecarMagic[8] = {'w', 'l', 'd', 'x', '\x1a', '\x0d', '\x0a', '\x02'};
+
+QString MapSidecar::sidecarPath(const QString &wldFile) {
+    QFileInfo info(wldFile);
+    return info.dir().filePath(info.completeBaseName() + ".wldx");
+}
+
+bool MapSidecar::currentKey(const QString &wldFile, Key *key) {
+    return MapJournal::fileChecksum(wldFile, &key->crc, &key->size);
+}
+
+MapSidecar::Key MapSidecar::keyOf(const QByteArray &wldBytes) {
+    // Mismo CRC que MapJournal::fileChecksum sobre el fichero
+    Key key;
+    key.size = wldBytes.size();
+    key.crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(wldBytes.constData()), uInt(wldBytes.size()));
+    return key;
+}
+
+bool MapSidecar::write(const QString &wldFile, const ModernMap &map, const Key &key,
+                       const std::atomic<bool> *cancel) {
+    MAP_TRACE_SPAN(lcGeometry, "MapSidecar::write");
+    const int numPoints = map.points.size();
+    const int numWalls = map.walls.size();
+    const int numRegions = map.regions.size();
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SidecarMagic, 8);
+    header.crc = key.crc;
+    header.size = key.size;
+    header.numRegions = numRegions;
+    header.numPoints = numPoints;
+    header.numWalls = numWalls;
+
+    // Caja del mapa y paredes de cada región en una pasada
+    std::vector<std::vector<int32_t>> regionWalls(numRegions);
+    for (int i = 0; i < numWalls; i++) {
+        const ModernWall &wall = map.walls[i];
+        if (wall.p1 >= 0 && wall.p1 < numPoints && wall.p2 >= 0 && wall.p2 < numPoints) {
+            const ModernPoint &p1 = map.points[wall.p1];
+            const ModernPoint &p2 = map.points[wall.p2];
+            if (!header.valid) {
+                header.minX = header.maxX = p1.x;
+                header.minY = header.maxY = p1.y;
+                header.valid = 1;
+            }
+            header.minX = std::min({header.minX, p1.x, p2.x});
+            header.minY = std::min({header.minY, p1.y, p2.y});
+            header.maxX = std::max({header.maxX, p1.x, p2.x});
+            header.maxY = std::max({header.maxY, p1.y, p2.y});
+        }
+        if (wall.front_region >= 0 && wall.front_region < numRegions) {
+            regionWalls[wall.front_region].push_back(i);
+        }
+    }
+
+    // Profundidad: es la parte cara, se calcula una vez sobre una copia
+    ModernMap sorted;
+    sorted.points = map.points;
+    sorted.walls = map.walls;
+    sorted.regions = map.regions;
+    sorted.sortRegionsByDepth();
+    if (cancel && cancel->load()) return false;
+
+    std::vector<SidecarRegion> regions(numRegions);
+    std::vector<SidecarPoint> ring;
+    ring.reserve(numWalls);
+    std::vector<int32_t> ringIndices;
+    for (int r = 0; r < numRegions; r++) {
+        SidecarRegion &region = regions[r];
+        region.ringStart = ring.size();
+        ringIndices.clear();
+        MapGeometry::regionRing(map, regionWalls[r], ringIndices);
+        for (int32_t point : ringIndices) ring.push_back({map.points[point].x, map.points[point].y});
+        region.ringCount = int32_t(ring.size()) - region.ringStart;
+        region.minX = region.minY = region.maxX = region.maxY = 0;
+        for (int i = region.ringStart; i < int(ring.size()); i++) {
+            if (i == region.ringStart) {
+                region.minX = region.maxX = ring[i].x;
+                region.minY = region.maxY = ring[i].y;
+            }
+            region.minX = std::min(region.minX, ring[i].x);
+            region.minY = std::min(region.minY, ring[i].y);
+            region.maxX = std::max(region.maxX, ring[i].x);
+            region.maxY = std::max(region.maxY, ring[i].y);
+        }
+        region.depth = sorted.regions[r].type;
+    }
+    if (cancel && cancel->load()) return false;
+
+    // Portales: las paredes se agrupan por arista sin orientación, así sólo
+    // se comparan las que comparten vértices
+    QHash<quint64, std::vector<int32_t>> byEdge;
+    byEdge.reserve(numWalls);
+    for (int i = 0; i < numWalls; i++) {
+        const ModernWall &wall = map.walls[i];
+        const quint64 key = (quint64(uint32_t(std::min(wall.p1, wall.p2))) << 32) |
+                            uint32_t(std::max(wall.p1, wall.p2));
+        byEdge[key].push_back(i);
+    }
+    std::vector<SidecarPortal> portals;
+    for (int i = 0; i < numWalls; i++) {
+        const ModernWall &wall = map.walls[i];
+        const quint64 key = (quint64(uint32_t(std::min(wall.p1, wall.p2))) << 32) |
+                            uint32_t(std::max(wall.p1, wall.p2));
+        for (int32_t j : byEdge.value(key)) {
+            if (j > i && ModernMap::wallsShareVertices(wall, map.walls[j]) &&
+                ModernMap::wallsHaveOppositeOrientation(wall, map.walls[j])) {
+                portals.push_back({i, j});
+            }
+        }
+    }
+
+    // Índice punto -> paredes (CSR)
+    std::vector<int32_t> adjacencyStart(numPoints + 1, 0);
+    for (const ModernWall &wall : map.walls) {
+        if (wall.p1 >= 0 && wall.p1 < numPoints) adjacencyStart[wall.p1 + 1]++;
+        if (wall.p2 >= 0 && wall.p2 < numPoints && wall.p2 != wall.p1) adjacencyStart[wall.p2 + 1]++;
+    }
+    for (int p = 0; p < numPoints; p++) adjacencyStart[p + 1] += adjacencyStart[p];
+    std::vector<int32_t> adjacencyWalls(adjacencyStart[numPoints]);
+    std::vector<int32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (int i = 0; i < numWalls; i++) {
+        const ModernWall &wall = map.walls[i];
+        if (wall.p1 >= 0 && wall.p1 < numPoints) adjacencyWalls[fill[wall.p1]++] = i;
+        if (wall.p2 >= 0 && wall.p2 < numPoints && wall.p2 != wall.p1) adjacencyWalls[fill[wall.p2]++] = i;
+    }
+
+    header.numRingPoints = ring.size();
+    header.numPortals = portals.size();
+    header.numAdjacency = adjacencyWalls.size();
+
+    // Un solo buffer y una sola escritura
+    QByteArray image;
+    image.reserve(int(sizeof(Header) + regions.size() * sizeof(SidecarRegion) +
+                      ring.size() * sizeof(SidecarPoint) + portals.size() * sizeof(SidecarPortal) +
+                      (adjacencyStart.size() + adjacencyWalls.size()) * sizeof(int32_t)));
+    image.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    image.append(reinterpret_cast<const char*>(regions.data()), int(regions.size() * sizeof(SidecarRegion)));
+    image.append(reinterpret_cast<const char*>(ring.data()), int(ring.size() * sizeof(SidecarPoint)));
+    image.append(reinterpret_cast<const char*>(portals.data()), int(portals.size() * sizeof(SidecarPortal)));
+    image.append(reinterpret_cast<const char*>(adjacencyStart.data()), int(adjacencyStart.size() * sizeof(int32_t)));
+    image.append(reinterpret_cast<const char*>(adjacencyWalls.data()), int(adjacencyWalls.size() * sizeof(int32_t)));
+
+    if (cancel && cancel->load()) return false;
+
+    QSaveFile out(sidecarPath(wldFile));
+    if (!out.open(QIODevice::WriteOnly)) return false;
+    if (out.write(image) != image.size()) {
+        out.cancelWriting();
+        return false;
+    }
+    return out.commit();
+}
+
+bool MapSidecar::open(const QString &wldFile, const Key &key) {
+    MAP_TRACE_SPAN(lcGeometry, "MapSidecar::open");
+    close();
+
+    file.setFileName(sidecarPath(wldFile));
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    const qint64 size = file.size();
+    if (size < qint64(sizeof(Header))) {
+        close();
+        return false;
+    }
+    data = file.map(0, size);
+    if (!data) {
+        close();
+        return false;
+    }
+
+    const Header *h = header();
+    if (memcmp(h->magic, SidecarMagic, 8) != 0 || h->crc != key.crc || h->size != key.size ||
+        h->numRegions < 0 || h->numRingPoints < 0 || h->numPortals < 0 ||
+        h->numPoints < 0 || h->numAdjacency < 0 || h->numWalls < 0) {
+        close();
+        return false;
+    }
+
+    const qint64 expected = qint64(sizeof(Header)) +
+                            qint64(h->numRegions) * sizeof(SidecarRegion) +
+                            qint64(h->numRingPoints) * sizeof(SidecarPoint) +
+                            qint64(h->numPortals) * sizeof(SidecarPortal) +
+                            (qint64(h->numPoints) + 1 + h->numAdjacency) * sizeof(int32_t);
+    if (size != expected) {
+        close();
+        return false;
+    }
+
+    const uchar *cursor = data + sizeof(Header);
+    regionsData = reinterpret_cast<const SidecarRegion*>(cursor);
+    cursor += qint64(h->numRegions) * sizeof(SidecarRegion);
+    ringData = reinterpret_cast<const SidecarPoint*>(cursor);
+    cursor += qint64(h->numRingPoints) * sizeof(SidecarPoint);
+    portalsData = reinterpret_cast<const SidecarPortal*>(cursor);
+    cursor += qint64(h->numPortals) * sizeof(SidecarPortal);
+    adjacencyStart = reinterpret_cast<const int32_t*>(cursor);
+    cursor += (qint64(h->numPoints) + 1) * sizeof(int32_t);
+    adjacencyWalls = reinterpret_cast<const int32_t*>(cursor);
+
+    // Rangos: nada de lo que se expone puede salirse del fichero
+    for (int r = 0; r < h->numRegions; r++) {
+        const SidecarRegion &region = regionsData[r];
+        if (region.ringStart < 0 || region.ringCount < 0 ||
+            qint64(region.ringStart) + region.ringCount > h->numRingPoints) {
+            close();
+            return false;
+        }
+    }
+    for (int i = 0; i < h->numPortals; i++) {
+        const SidecarPortal &portal = portalsData[i];
+        if (portal.wall < 0 || portal.wall >= h->numWalls || portal.other < 0 || portal.other >= h->numWalls) {
+            close();
+            return false;
+        }
+    }
+    if (adjacencyStart[0] != 0 || adjacencyStart[h->numPoints] != h->numAdjacency) {
+        close();
+        return false;
+    }
+    for (int i = 0; i < h->numAdjacency; i++) {
+        if (adjacencyWalls[i] < 0 || adjacencyWalls[i] >= h->numWalls) {
+            close();
+            return false;
+        }
+    }
+    for (int p = 0; p < h->numPoints; p++) {
+        if (adjacencyStart[p + 1] < adjacencyStart[p]) {
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void MapSidecar::close() {
+    if (data) file.unmap(const_cast<uchar*>(data));
+    if (file.isOpen()) file.close();
+    data = nullptr;
+    regionsData = nullptr;
+    ringData = nullptr;
+    portalsData = nullptr;
+    adjacencyStart = nullptr;
+    adjacencyWalls = nullptr;
+}
+
+const MapSidecar::SidecarPoint *MapSidecar::ring(int region, int32_t *count) const {
+    *count = regionsData[region].ringCount;
+    return ringData + regionsData[region].ringStart;
+}
+
+const int32_t *MapSidecar::wallsAtPoint(int point, int32_t *count) const {
+    *count = adjacencyStart[point + 1] - adjacencyStart[point];
+    return adjacencyWalls + adjacencyStart[point];
+}
+
+MapGeometry MapSidecar::geometry() const {
+    MapGeometry geometry;
+    const Header *h = header();
+    geometry.valid = h->valid != 0;
+    geometry.minX = h->minX;
+    geometry.minY = h->minY;
+    geometry.maxX = h->maxX;
+    geometry.maxY = h->maxY;
+
+    geometry.regionPoints.resize(h->numRegions);
+    for (int r = 0; r < h->numRegions; r++) {
+        int32_t count;
+        const SidecarPoint *points = ring(r, &count);
+        std::vector<QPointF> &sectorPoints = geometry.regionPoints[r];
+        sectorPoints.reserve(count);
+        for (int i = 0; i < count; i++) sectorPoints.push_back(QPointF(points[i].x, points[i].y));
+    }
+    return geometry;
+}
+
+bool MapSidecar::applyRegionsAndPortals(ModernMap &map) const {
+    const Header *h = header();
+    // open() ya comprobó que los portales están en [0, numWalls)
+    if (h->numRegions != int(map.regions.size()) || h->numPoints != int(map.points.size()) ||
+        h->numWalls != int(map.walls.size())) return false;
+
+    for (int r = 0; r < h->numRegions; r++) map.regions[r].type = regionsData[r].depth;
+
+    for (ModernWall &wall : map.walls) {
+        wall.back_region = -1;
+        wall.type = 2; // Pared normal
+    }
+
+    // Mismo orden de aplicación que assignRegionsAndPortals (por wall y luego other)
+    for (int i = 0; i < h->numPortals; i++) {
+        ModernWall &wall = map.walls[portalsData[i].wall];
+        wall.back_region = map.walls[portalsData[i].other].front_region;
+        wall.type = 1; // Portal
+        wall.texture_top = wall.texture;
+        wall.texture_bot = wall.texture;
+        wall.texture = 0;
+    }
+    return true;
+}
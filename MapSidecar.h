@@ -0,0 +1,109 @@
+#ifndef MAPSIDECAR_H
+#define MAPSIDECAR_H
+
+#include <QFile>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include "MapStructures.h"
+#include "MapGeometry.h"
+
+// Fichero .wldx junto al WLD con los datos derivados que de otro modo se
+// recalculan en cada apertura: anillos ordenados de cada región, su caja,
+// profundidad (type tras sortRegionsByDepth), pares de paredes portal y un
+// índice punto -> paredes. Va ligado al CRC y tamaño de los bytes del WLD;
+// si no coinciden el sidecar está caducado y hay que regenerarlo.
+//
+// Formato (enteros de 32 bits en el orden de bytes nativo, como el WLD):
+//   cabecera     magic[8] crc size valid minX minY maxX maxY
+//                numRegions numRingPoints numPortals numPoints numAdjacency numWalls
+//   regiones     SidecarRegion[numRegions]
+//   anillos      SidecarPoint[numRingPoints]
+//   portales     SidecarPortal[numPortals]
+//   adyacencia   int32 start[numPoints + 1], int32 walls[numAdjacency]
+class MapSidecar {
+public:
+    struct Key {
+        uint32_t crc = 0;
+        int32_t size = 0;
+    };
+
+    struct SidecarRegion {
+        int32_t ringStart, ringCount;
+        int32_t minX, minY, maxX, maxY;
+        int32_t depth;
+    };
+
+    struct SidecarPoint {
+        int32_t x, y;
+    };
+
+    // Misma semántica que el bucle de assignRegionsAndPortals: wall comparte
+    // vértices con other (other > wall) y tienen distinta región frontal
+    struct SidecarPortal {
+        int32_t wall, other;
+    };
+
+    MapSidecar() = default;
+    ~MapSidecar() { close(); }
+
+    MapSidecar(const MapSidecar &) = delete;
+    MapSidecar &operator=(const MapSidecar &) = delete;
+
+    static QString sidecarPath(const QString &wldFile);
+    static bool currentKey(const QString &wldFile, Key *key);
+    static Key keyOf(const QByteArray &wldBytes);   // Bytes tal y como quedan en disco
+
+    // Calcula los datos derivados de map y los guarda ligados a key, que debe
+    // ser la clave de los bytes de los que se cargó map
+    static bool write(const QString &wldFile, const ModernMap &map, const Key &key,
+                      const std::atomic<bool> *cancel = nullptr);
+
+    // Mapea el sidecar de wldFile. Devuelve false si no existe, está dañado o
+    // no corresponde al contenido actual del WLD.
+    bool open(const QString &wldFile, const Key &key);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+
+    int32_t regionCount() const { return header()->numRegions; }
+    const SidecarRegion *regions() const { return regionsData; }
+    const SidecarPoint *ring(int region, int32_t *count) const;
+    int32_t portalCount() const { return header()->numPortals; }
+    const SidecarPortal *portals() const { return portalsData; }
+    const int32_t *wallsAtPoint(int point, int32_t *count) const;
+
+    // Geometría para drawWLDMap sin recorrer las paredes
+    MapGeometry geometry() const;
+
+    // Resultado de assignRegionsAndPortals sin el coste cuadrático. Devuelve
+    // false (sin tocar map) si el mapa no tiene los puntos, paredes y
+    // regiones del sidecar.
+    bool applyRegionsAndPortals(ModernMap &map) const;
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t crc;
+        int32_t size;
+        int32_t valid;
+        int32_t minX, minY, maxX, maxY;
+        int32_t numRegions;
+        int32_t numRingPoints;
+        int32_t numPortals;
+        int32_t numPoints;
+        int32_t numAdjacency;
+        int32_t numWalls;
+    };
+
+    const Header *header() const { return reinterpret_cast<const Header*>(data); }
+
+    QFile file;
+    const uchar *data = nullptr;
+    const SidecarRegion *regionsData = nullptr;
+    const SidecarPoint *ringData = nullptr;
+    const SidecarPortal *portalsData = nullptr;
+    const int32_t *adjacencyStart = nullptr;
+    const int32_t *adjacencyWalls = nullptr;
+};
+
+#endif // MAPSIDECAR_H
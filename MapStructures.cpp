@@ -1,11 +1,20 @@
 #include "MapStructures.h"
+#include "MapTrace.h"
 #include "divmap3d.hpp"
+#include "WLDFile.h"
+#include "FPGTextureSource.h"
+#include "GzipUtils.h"
 #include <QFileInfo>
 #include <QString>
 #include <QByteArray>
 #include <QFile>
+#include <QSaveFile>
+#include <QPixmapCache>
+#include <zlib.h>
 #include <cstring>
 #include <cstdio>
+#include <cstddef>
+#include <type_traits>
 
 #pragma pack(push, 1)
 
@@ -15,189 +24,492 @@ static_assert(sizeof(twall) == 40, "twall size mismatch");
 static_assert(sizeof(tregion) == 28, "tregion size mismatch");
 static_assert(sizeof(tflag) == 16, "tflag size mismatch");
 
-bool ModernMap::saveToWLD(const QString &filename) {
-    FILE *f = fopen(filename.toUtf8().constData(), "wb");
-    if (!f) return false;
+// loadFromWLD copia puntos y paredes en bloque desde el fichero mapeado
+static_assert(sizeof(ModernPoint) == sizeof(tpoint) && std::is_trivially_copyable<ModernPoint>::value,
+              "ModernPoint layout must match tpoint");
+static_assert(sizeof(ModernWall) == sizeof(twall) && std::is_trivially_copyable<ModernWall>::value,
+              "ModernWall layout must match twall");
+static_assert(offsetof(ModernPoint, links) == offsetof(tpoint, links), "ModernPoint layout must match tpoint");
+static_assert(offsetof(ModernWall, fade) == offsetof(twall, fade), "ModernWall layout must match twall");
 
-    // *** DEBUG: Verificar tamaños ***
-    printf("sizeof(tpoint) = %d (debe ser 16)\n", sizeof(tpoint));
-    printf("sizeof(twall) = %d (debe ser 40)\n", sizeof(twall));
-    printf("sizeof(tregion) = %d (debe ser 32)\n", sizeof(tregion));
-    printf("sizeof(tflag) = %d (debe ser 16)\n", sizeof(tflag));
+QImage TextureEntry::image() const {
+    return isNull() ? QImage() : source->image(chunk);
+}
+
+QPixmap TextureEntry::pixmap() const {
+    return isNull() ? QPixmap() : QPixmap::fromImage(image());
+}
+
+void ModernMap::setTextures(const QVector<TextureEntry> &entries) {
+    textures = entries;
+    invalidateTextureIndex();
+}
+
+int ModernMap::textureIndex(uint32_t code) const {
+    if (!textureIndexValid || indexedCount != textures.size() || indexedData != textures.constData()) {
+        rebuildTextureIndex();
+    }
+
+    int index = textureByCode.value(code, -1);
+    if (index >= 0 && textures[index].id != code) {
+        // Se cambió un código sin tocar el tamaño del vector
+        rebuildTextureIndex();
+        index = textureByCode.value(code, -1);
+    }
+    return index;
+}
+
+const TextureEntry *ModernMap::findTexture(uint32_t code) const {
+    const int index = textureIndex(code);
+    return index >= 0 ? &textures[index] : nullptr;
+}
+
+void ModernMap::rebuildTextureIndex() const {
+    textureByCode.clear();
+    textureByCode.reserve(textures.size());
+    // Con códigos repetidos gana el primero, como en la búsqueda lineal
+    for (int i = textures.size() - 1; i >= 0; i--) textureByCode.insert(textures[i].id, i);
+    indexedData = textures.constData();
+    indexedCount = textures.size();
+    textureIndexValid = true;
+}
+
+void ModernMap::eraseRegion(int index) {
+    if (index < 0 || index >= int(regions.size())) return;
+    regions.erase(regions.begin() + index);
+
+    auto remap = [index](int32_t region) {
+        return region == index ? -1 : (region > index ? region - 1 : region);
+    };
+    for (ModernWall &wall : walls) {
+        wall.front_region = remap(wall.front_region);
+        wall.back_region = remap(wall.back_region);
+    }
+}
+
+bool TextureEntry::thumbnailReady() const {
+    return !isNull() && source->hasThumbnail(chunk);
+}
+
+QPixmap TextureEntry::thumbnail(int size) const {
+    if (isNull()) return QPixmap();
+
+    // Los QPixmap también se guardan: volver a pedir la misma miniatura no
+    // convierte ni escala nada
+    const QString key = QString("fpgthumb:%1:%2:%3").arg(source->id()).arg(source->canonicalChunk(chunk)).arg(size);
+    QPixmap pixmap;
+    if (!QPixmapCache::find(key, &pixmap)) {
+        pixmap = QPixmap::fromImage(source->thumbnail(chunk, size));
+        QPixmapCache::insert(key, pixmap);
+    }
+    return pixmap;
+}
+
+// Copia una cadena en un campo de tamaño fijo relleno con ceros (como divmap3d)
+static void writeFixedString(char *dst, int fieldSize, const QString &text) {
+    QByteArray bytes = text.toUtf8();
+    memset(dst, 0, fieldSize);
+    memcpy(dst, bytes.constData(), qMin<int>(bytes.size(), fieldSize - 1));
+}
+
+QByteArray ModernMap::toWLDImage(const QString &filename) const {
+    // Tamaño total exacto como divmap3d (todo lo que sigue a magic + total)
+    const int total = 548 + 4 + points.size() * sizeof(tpoint)
+                      + 4 + walls.size() * sizeof(twall)
+                      + 4 + regions.size() * sizeof(tregion)
+                      + 4 + 0 * sizeof(tflag) + 4;
+
+    // Un único buffer contiguo con la imagen completa del fichero
+    QByteArray image(8 + 4 + total, Qt::Uninitialized);
+    char *out = image.data();
 
     // Header exacto como divmap3d
-    fwrite("wld\x1a\x0d\x0a\x01\x00", 8, 1, f);
-
-    // Calcular tamaño total exacto como divmap3d
-    int total = 548 + 4 + points.size() * sizeof(tpoint)
-                + 4 + walls.size() * sizeof(twall)
-                + 4 + regions.size() * sizeof(tregion)
-                + 4 + 0 * sizeof(tflag) + 4;
-    fwrite(&total, 4, 1, f);
-
-    // Paths exactamente como divmap3d
-    char path[256] = {0};
-    char name[16] = {0};
-
-    // m3d_path - ruta completa del WLD
-    QByteArray wldPath = filename.toUtf8();
-    memset(path, 0, 256);
-    memcpy(path, wldPath.constData(), qMin(wldPath.size(), 255));
-    fwrite(path, 256, 1, f);
-
-    // m3d_name - nombre del archivo WLD
-    QFileInfo wldInfo(filename);
-    QString wldName = wldInfo.fileName();
-    QByteArray wldNameBytes = wldName.toUtf8();
-    memset(name, 0, 16);
-    memcpy(name, wldNameBytes.constData(), qMin(wldNameBytes.size(), 15));
-    fwrite(name, 16, 1, f);
+    memcpy(out, "wld\x1a\x0d\x0a\x01\x00", 8);
+    out += 8;
+    memcpy(out, &total, 4);
+    out += 4;
+
+    // m3d_path y m3d_name - ruta completa y nombre del WLD
+    writeFixedString(out, 256, filename);
+    out += 256;
+    writeFixedString(out, 16, QFileInfo(filename).fileName());
+    out += 16;
 
     // numero - siempre 0
-    int numero = 0;
-    fwrite(&numero, 4, 1, f);
-
-    // fpg_path y fpg_name
-    if (!textures.isEmpty()) {
-        QString fpgPath = textures[0].filename;
-        QByteArray fpgBytes = fpgPath.toUtf8();
-
-        memset(path, 0, 256);
-        memcpy(path, fpgBytes.constData(), qMin(fpgBytes.size(), 255));
-        fwrite(path, 256, 1, f);
-
-        QFileInfo fpgInfo(fpgPath);
-        QString fpgName = fpgInfo.fileName();
-        QByteArray fpgNameBytes = fpgName.toUtf8();
-        memset(name, 0, 16);
-        memcpy(name, fpgNameBytes.constData(), qMin(fpgNameBytes.size(), 15));
-        fwrite(name, 16, 1, f);
-    } else {
-        fwrite(path, 256, 1, f);  // fpg_path vacío
-        fwrite(name, 16, 1, f);   // fpg_name vacío
-    }
-
-    // Escribir puntos como tpoint
+    memset(out, 0, 4);
+    out += 4;
+
+    // fpg_path y fpg_name: el FPG cargado o, si no hay, el que traía el WLD
+    QString fpg = textures.isEmpty() ? fpgPath : textures[0].filename;
+    writeFixedString(out, 256, fpg);
+    out += 256;
+    writeFixedString(out, 16, fpg.isEmpty() ? QString() : QFileInfo(fpg).fileName());
+    out += 16;
+
+    // Puntos como tpoint
     int32_t count = points.size();
-    fwrite(&count, 4, 1, f);
+    memcpy(out, &count, 4);
+    out += 4;
     for (const ModernPoint &p : points) {
         tpoint tp = {p.active, p.x, p.y, p.links};
-        fwrite(&tp, sizeof(tpoint), 1, f);
+        memcpy(out, &tp, sizeof(tpoint));
+        out += sizeof(tpoint);
     }
 
-    // Escribir paredes como twall
+    // Paredes como twall
     count = walls.size();
-    fwrite(&count, 4, 1, f);
+    memcpy(out, &count, 4);
+    out += 4;
     for (const ModernWall &w : walls) {
         twall tw = {w.active, w.type, w.p1, w.p2, w.front_region, w.back_region,
                     w.texture, w.texture_top, w.texture_bot, w.fade};
-        fwrite(&tw, sizeof(twall), 1, f);
+        memcpy(out, &tw, sizeof(twall));
+        out += sizeof(twall);
     }
 
-    // Escribir regiones como tregion
+    // Regiones como tregion
     count = regions.size();
-    fwrite(&count, 4, 1, f);
+    memcpy(out, &count, 4);
+    out += 4;
     for (const ModernRegion &r : regions) {
         tregion tr = {r.active, r.type, r.floor_height, r.ceiling_height,
                       r.floor_tex, r.ceil_tex, r.fade};
-        fwrite(&tr, sizeof(tregion), 1, f);
+        memcpy(out, &tr, sizeof(tregion));
+        out += sizeof(tregion);
+    }
+
+    // Flags (siempre 0) y fondo
+    memset(out, 0, 4 + 4);
+
+    return image;
+}
+
+bool ModernMap::saveToWLD(const QString &filename, bool compressed,
+                          const std::atomic<bool> *cancel, QByteArray *written) const {
+    QByteArray image = toWLDImage(filename);
+
+    // Modo comprimido: el mismo WLD envuelto en gzip (loadFromWLD lo detecta)
+    if (compressed) {
+        image = gzipCompress(image.constData(), image.size(), Z_BEST_COMPRESSION);
+        if (image.isEmpty()) return false;
     }
 
-    // Escribir flags (siempre 0)
-    count = 0;
-    fwrite(&count, 4, 1, f);
+    // QSaveFile escribe en un temporal y lo renombra al hacer commit(),
+    // así nunca queda un .wld a medio escribir si algo falla
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) return false;
 
-    // Escribir fondo
-    int fondo = 0;
-    fwrite(&fondo, 4, 1, f);
+    if (file.write(image) != image.size() || (cancel && cancel->load())) {
+        file.cancelWriting();
+        return false;
+    }
 
-    fclose(f);
+    if (!file.commit()) return false;
+    if (written) *written = image;
     return true;
 }
 
-bool ModernMap::loadFromWLD(const QString &filename) {
-    FILE *f = fopen(filename.toUtf8().constData(), "rb");
-    if (!f) return false;
+// Límite de coordenadas de divmap3d; el formato DAT invierte el eje Y
+static const int FIN_GRID = 32768 - 2560;
+
+static inline bool fitsM8Short(int32_t value) {
+    return value >= -32768 && value <= 32767;
+}
+
+bool ModernMap::saveToDAT(const QString &filename, QStringList *overflows) const {
+    // Como map_save de divmap3d: WLD editable seguido de la zona DAT
+    // (ZF_Header, ZF_Point, ZF_Region, ZF_Wall, ZF_Flag, ZF_General)
+    const QByteArray wld = toWLDImage(filename);
+    const int numPoints = points.size();
+    const int numRegions = regions.size();
+    const int numWalls = walls.size();
+
+    const qint64 datSize = sizeof(ZF_Header) + numPoints * sizeof(ZF_Point)
+                           + numRegions * sizeof(ZF_Region) + numWalls * sizeof(ZF_Wall)
+                           + sizeof(ZF_General);
+
+    QByteArray image(int(wld.size() + datSize), '\0');
+    memcpy(image.data(), wld.constData(), wld.size());
+
+    // Todos los bloques empiezan en múltiplos de 4: se escribe en sitio
+    char *out = image.data() + wld.size();
+    ZF_Header *header = reinterpret_cast<ZF_Header*>(out);
+    ZF_Point *zp = reinterpret_cast<ZF_Point*>(out + sizeof(ZF_Header));
+    ZF_Region *zr = reinterpret_cast<ZF_Region*>(zp + numPoints);
+    ZF_Wall *zw = reinterpret_cast<ZF_Wall*>(zr + numRegions);
+    ZF_General *zgen = reinterpret_cast<ZF_General*>(zw + numWalls);
+
+    memcpy(header->IDStr, "DAT", 4);
+    header->NumPoints = M8SHORT(numPoints);
+    header->NumRegions = M8SHORT(numRegions);
+    header->NumWalls = M8SHORT(numWalls);
+    header->NumFlags = 0;
+
+    // Una pasada por array sin ramas: estrechar a M8SHORT y acumular si
+    // algún valor no cabe. Sólo si hay desbordes se buscan los culpables.
+    for (int i = 0; i < numPoints; i++) {
+        zp[i].Type = 0;
+        zp[i].x = points[i].x;
+        zp[i].y = FIN_GRID - points[i].y;
+        zp[i].path = -1;
+        zp[i].link = -1;
+    }
+
+    int32_t regionOverflow = 0;
+    for (int i = 0; i < numRegions; i++) {
+        const ModernRegion &r = regions[i];
+        zr[i].Type = 0;
+        zr[i].FloorH = M8SHORT(r.floor_height);
+        zr[i].CeilH = M8SHORT(r.ceiling_height);
+        zr[i].Below = -1;
+        zr[i].Above = -1;
+        zr[i].FloorTex = r.floor_tex;
+        zr[i].CeilTex = r.ceil_tex;
+        memcpy(zr[i].Eff, "NO_NAME", 8);
+        zr[i].Fade = M8SHORT(r.fade);
+        zr[i].Tag = 0;
+        regionOverflow |= (zr[i].FloorH != r.floor_height) | (zr[i].CeilH != r.ceiling_height)
+                          | (zr[i].Fade != r.fade);
+    }
+
+    int32_t wallOverflow = 0;
+    for (int i = 0; i < numWalls; i++) {
+        const ModernWall &w = walls[i];
+        zw[i].Type = w.type;
+        zw[i].p1 = M8SHORT(w.p1);
+        zw[i].p2 = M8SHORT(w.p2);
+        zw[i].Front = M8SHORT(w.front_region);
+        zw[i].Back = M8SHORT(w.back_region);
+        zw[i].TopTex = w.texture_top;
+        zw[i].MidTex = w.texture;
+        zw[i].BotTex = w.texture_bot;
+        memcpy(zw[i].Eff, "NO_NAME", 8);
+        zw[i].Fade = M8SHORT(w.fade);
+        zw[i].TexX = 0;
+        zw[i].TexY = 0;
+        zw[i].Mass = 0;
+        zw[i].Tag = 0;
+        wallOverflow |= (zw[i].p1 != w.p1) | (zw[i].p2 != w.p2) | (zw[i].Front != w.front_region)
+                        | (zw[i].Back != w.back_region) | (zw[i].Fade != w.fade);
+    }
+
+    // Información general con los valores fijos de map_save
+    memcpy(zgen->Title, "Mapa1", 6);
+    memcpy(zgen->Palette, "paleta", 7);
+    zgen->ScrTex = 0;
+    zgen->BackTex = 0;
+    memcpy(zgen->BackEff, "NO_NAME", 8);
+    zgen->BackAngle = 120;
+    zgen->ActView = 0;
+    zgen->Force.x = 200;
+    zgen->Force.y = 200;
+    zgen->Force.z = 400;
+    zgen->Force.t = 100;
+
+    // Informar de cada valor que no cabe en vez de truncarlo en silencio
+    QStringList found;
+    if (!fitsM8Short(numPoints) || !fitsM8Short(numRegions) || !fitsM8Short(numWalls)) {
+        found << QString("Cabecera: %1 puntos, %2 regiones, %3 paredes").arg(numPoints).arg(numRegions).arg(numWalls);
+    }
+    for (int i = 0; regionOverflow && i < numRegions; i++) {
+        const ModernRegion &r = regions[i];
+        if (!fitsM8Short(r.floor_height)) found << QString("Región %1: floor_height=%2").arg(i).arg(r.floor_height);
+        if (!fitsM8Short(r.ceiling_height)) found << QString("Región %1: ceiling_height=%2").arg(i).arg(r.ceiling_height);
+        if (!fitsM8Short(r.fade)) found << QString("Región %1: fade=%2").arg(i).arg(r.fade);
+    }
+    for (int i = 0; wallOverflow && i < numWalls; i++) {
+        const ModernWall &w = walls[i];
+        if (!fitsM8Short(w.p1)) found << QString("Pared %1: p1=%2").arg(i).arg(w.p1);
+        if (!fitsM8Short(w.p2)) found << QString("Pared %1: p2=%2").arg(i).arg(w.p2);
+        if (!fitsM8Short(w.front_region)) found << QString("Pared %1: front_region=%2").arg(i).arg(w.front_region);
+        if (!fitsM8Short(w.back_region)) found << QString("Pared %1: back_region=%2").arg(i).arg(w.back_region);
+        if (!fitsM8Short(w.fade)) found << QString("Pared %1: fade=%2").arg(i).arg(w.fade);
+    }
 
-    // Validar header
-    char header[8];
-    fread(header, 8, 1, f);
-    if (strncmp(header, "wld\x1a\x0d\x0a\x01\x00", 8) != 0) {
-        fclose(f);
+    if (!found.isEmpty()) {
+        if (overflows) *overflows = found;
         return false;
     }
 
-    // Leer tamaño total
-    int total;
-    fread(&total, 4, 1, f);
-
-    // Leer paths
-    char path[256], name[16];
-    fread(path, 256, 1, f);
-    fread(name, 16, 1, f);
-    int numero;
-    fread(&numero, 4, 1, f);
-
-    // Leer fpg_path y fpg_name
-    char fpg_path[256], fpg_name[16];
-    fread(fpg_path, 256, 1, f);
-    fread(fpg_name, 16, 1, f);
-
-    // Leer puntos como tpoint
-    int32_t count;
-    fread(&count, 4, 1, f);
-    points.resize(count);
-    for (int i = 0; i < count; i++) {
-        tpoint tp;
-        fread(&tp, sizeof(tpoint), 1, f);
-        points[i].active = tp.active;
-        points[i].x = tp.x;
-        points[i].y = tp.y;
-        points[i].links = tp.links;
-    }
-
-    // Leer paredes como twall
-    fread(&count, 4, 1, f);
-    walls.resize(count);
-    for (int i = 0; i < count; i++) {
-        twall tw;
-        fread(&tw, sizeof(twall), 1, f);
-        walls[i].active = tw.active;
-        walls[i].type = tw.type;
-        walls[i].p1 = tw.p1;
-        walls[i].p2 = tw.p2;
-        walls[i].front_region = tw.front_region;
-        walls[i].back_region = tw.back_region;
-        walls[i].texture = tw.texture;
-        walls[i].texture_top = tw.texture_top;
-        walls[i].texture_bot = tw.texture_bot;
-        walls[i].fade = tw.fade;
-    }
-
-    // Leer regiones como tregion
-    fread(&count, 4, 1, f);
-    regions.resize(count);
-    for (int i = 0; i < count; i++) {
-        tregion tr;
-        fread(&tr, sizeof(tregion), 1, f);
-        regions[i].active = tr.active;
-        regions[i].type = tr.type;
-        regions[i].floor_height = tr.floor_height;
-        regions[i].ceiling_height = tr.ceil_height;
-        regions[i].floor_tex = tr.floor_tex;
-        regions[i].ceil_tex = tr.ceil_tex;
-        regions[i].fade = tr.fade;
-    }
-
-    // Leer flags
-    fread(&count, 4, 1, f);
-
-    // Leer fondo
-    int fondo;
-    fread(&fondo, 4, 1, f);
-
-    fclose(f);
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) return false;
+    if (file.write(image) != image.size()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool ModernMap::loadFromWLD(const QString &filename, ParseError *error,
+                            uint32_t *fileCrc, int32_t *fileSize) {
+    MAP_TRACE_SPAN(lcLoad, "ModernMap::loadFromWLD");
+
+    // open() valida contadores y referencias antes de que se reserve nada
+    WLDFile wld;
+    if (!wld.open(filename, error, fileCrc || fileSize)) return false;
+    if (fileCrc) *fileCrc = wld.fileCrc();
+    if (fileSize) *fileSize = wld.fileSize();
+
+    // Puntos y paredes tienen el mismo layout que tpoint/twall: copia en bloque
+    points.resize(wld.pointCount());
+    memcpy(points.data(), wld.points(), wld.pointCount() * sizeof(tpoint));
+
+    walls.resize(wld.wallCount());
+    memcpy(walls.data(), wld.walls(), wld.wallCount() * sizeof(twall));
+
+    fpgPath = wld.fpgPath();
+    fpgName = wld.fpgName();
+
+    // Las regiones tienen campos extra (wall_tex, points) y se convierten una a una
+    regions.clear();
+    regions.resize(wld.regionCount());
+    const tregion *tr = wld.regions();
+    for (int i = 0; i < wld.regionCount(); i++) {
+        regions[i].active = tr[i].active;
+        regions[i].type = tr[i].type;
+        regions[i].floor_height = tr[i].floor_height;
+        regions[i].ceiling_height = tr[i].ceil_height;
+        regions[i].floor_tex = tr[i].floor_tex;
+        regions[i].ceil_tex = tr[i].ceil_tex;
+        regions[i].fade = tr[i].fade;
+    }
+
     return true;
 }
 
+void ModernMap::assignRegionsAndPortals() {
+    MAP_TRACE_SPAN(lcGeometry, "ModernMap::assignRegionsAndPortals");
+
+    // Ordenar regiones por profundidad primero
+    sortRegionsByDepth();
+
+    // Analizar cada pared para determinar portales
+    for (int i = 0; i < walls.size(); i++) {
+        ModernWall &wall = walls[i];
+
+        // Inicializar como pared normal
+        wall.back_region = -1;
+        wall.type = 2; // Pared normal
+
+        // Buscar paredes compartidas (portales potenciales)
+        for (int j = i + 1; j < walls.size(); j++) {
+            if (wallsShareVertices(wall, walls[j])) {
+                if (wallsHaveOppositeOrientation(wall, walls[j])) {
+                    // Es un portal - asignar back_region
+                    wall.back_region = walls[j].front_region;
+                    wall.type = 1; // Portal
+
+                    // Configurar texturas para portal
+                    wall.texture_top = wall.texture;
+                    wall.texture_bot = wall.texture;
+                    wall.texture = 0; // Sin textura media en portales
+                }
+            }
+        }
+    }
+}
+
+bool ModernMap::wallsShareVertices(const ModernWall &w1, const ModernWall &w2) {
+    return (w1.p1 == w2.p1 && w1.p2 == w2.p2) ||
+           (w1.p1 == w2.p2 && w1.p2 == w2.p1);
+}
+
+bool ModernMap::wallsHaveOppositeOrientation(const ModernWall &w1, const ModernWall &w2) {
+    return w1.front_region != w2.front_region;
+}
+
+void ModernMap::sortRegionsByDepth() {
+    MAP_TRACE_SPAN(lcGeometry, "ModernMap::sortRegionsByDepth");
+
+    if (regions.size() <= 1) {
+        return;
+    }
+
+    // Inicializar todas las regiones con type = 1 (nivel más externo)
+    for (int i = 0; i < regions.size(); i++) {
+        regions[i].type = 1;
+    }
+
+    // Calcular el número máximo de vértices por región
+    int maxVertex = 0;
+    std::vector<int> regionVertexCount(regions.size(), 0);
+
+    for (const ModernWall &wall : walls) {
+        if (wall.front_region >= 0 && wall.front_region < regions.size()) {
+            regionVertexCount[wall.front_region]++;
+        }
+    }
+
+    for (int count : regionVertexCount) {
+        if (count + 1 > maxVertex) {
+            maxVertex = count + 1;
+        }
+    }
+
+    // Crear polígonos para cada región
+    std::vector<std::vector<QPointF>> regionPolygons(regions.size());
+
+    for (int regionIdx = 0; regionIdx < regions.size(); regionIdx++) {
+        std::vector<QPointF> vertices;
+
+        for (const ModernWall &wall : walls) {
+            if (wall.front_region == regionIdx) {
+                if (wall.p1 < points.size()) {
+                    vertices.push_back(QPointF(points[wall.p1].x,
+                                               points[wall.p1].y));
+                }
+            }
+        }
+
+        regionPolygons[regionIdx] = vertices;
+    }
+
+    // Determinar profundidad de cada región
+    for (int wallIdx = 0; wallIdx < walls.size(); wallIdx++) {
+        const ModernWall &wall = walls[wallIdx];
+
+        // Calcular punto medio de la pared
+        if (wall.p1 < points.size() && wall.p2 < points.size() &&
+            wall.front_region >= 0 && wall.front_region < regions.size()) {
+            qreal midX = (points[wall.p1].x + points[wall.p2].x) / 2.0;
+            qreal midY = (points[wall.p1].y + points[wall.p2].y) / 2.0;
+
+            // Determinar en qué regiones está este punto medio
+            int maxDepth = 1;
+            for (int regionIdx = 0; regionIdx < regions.size(); regionIdx++) {
+                if (regionIdx != wall.front_region && isPointInRegion(midX, midY, regionPolygons[regionIdx])) {
+                    if (regions[regionIdx].type > maxDepth) {
+                        maxDepth = regions[regionIdx].type;
+                    }
+                }
+            }
+
+            // Actualizar profundidad de la región frontal
+            if (maxDepth > regions[wall.front_region].type) {
+                regions[wall.front_region].type = maxDepth;
+            }
+        }
+    }
+}
+
+bool ModernMap::isPointInRegion(qreal x, qreal y, const std::vector<QPointF> &polygon) {
+    if (polygon.size() < 3) return false;
+
+    bool inside = false;
+    int j = polygon.size() - 1;
+
+    for (int i = 0; i < polygon.size(); i++) {
+        const QPointF &pi = polygon[i];
+        const QPointF &pj = polygon[j];
+
+        if (((pi.y() > y) != (pj.y() > y)) &&
+            (x < (pj.x() - pi.x()) * (y - pi.y()) / (pj.y() - pi.y()) + pi.x())) {
+            inside = !inside;
+        }
+        j = i;
+    }
+
+    return inside;
+}
+
 #pragma pack(pop)
@@ -2,14 +2,19 @@
 #define MAPSTRUCTURES_H
 
 #include <QVector>
+#include <QHash>
 #include <QPointF>
 #include <QString>
+#include <QStringList>
+#include <QByteArray>
 #include <cstdint>
 #include <QPixmap>
 #include <memory>
+#include <atomic>
 #include <vector>
 #include <cstdio>
 #include "divmap3d.hpp"
+#include "ParseError.h"
 
 // Estructuras para formato FPG de BennuGD2
 typedef struct {
@@ -27,14 +32,32 @@ typedef struct {
     uint16_t y;
 } FPG_CONTROL_POINT;
 
+class FPGTextureSource;
+
 // TextureEntry debe estar definido ANTES de ModernMap
+// Los píxeles no viven aquí: se piden al FPG de origen (compartido entre
+// copias) y sólo se decodifican cuando alguien los necesita
 struct TextureEntry {
     QString filename;
     uint32_t id;
-    QPixmap pixmap;
+    int32_t width = 0;
+    int32_t height = 0;
+
+    std::shared_ptr<FPGTextureSource> source;
+    int chunk = -1;             // Índice del chunk en source
 
     TextureEntry() : id(0) {}
     TextureEntry(const QString &fname, uint32_t tid) : filename(fname), id(tid) {}
+
+    bool isNull() const { return !source || chunk < 0; }
+    QImage image() const;       // Cualquier hilo
+    QPixmap pixmap() const;     // Sólo en el hilo de la GUI
+
+    // Miniatura que cabe en size x size, de la pirámide compartida del FPG
+    // (16/32/64/128). Sólo en el hilo de la GUI. Si la pirámide aún no está
+    // hecha la construye en el momento; thumbnailReady() dice si ya lo está.
+    QPixmap thumbnail(int size) const;
+    bool thumbnailReady() const;
 };
 
 // Envoltorio moderno de tpoint con manejo automático de memoria
@@ -160,16 +183,64 @@ public:
     std::vector<ModernWall> walls;
     QVector<TextureEntry> textures;  // QVector para compatibilidad Qt
 
+    // FPG indicado en la cabecera del último WLD cargado
+    QString fpgPath;
+    QString fpgName;
+
     void clear() {
         points.clear();
         regions.clear();
         walls.clear();
-        textures.clear();
+        setTextures(QVector<TextureEntry>());
+        fpgPath.clear();
+        fpgName.clear();
     }
 
+    // Sustituye la lista de texturas e invalida el índice por código. Quien
+    // cambie códigos dentro de textures debe llamar a invalidateTextureIndex().
+    void setTextures(const QVector<TextureEntry> &entries);
+    void invalidateTextureIndex() { textureIndexValid = false; }
+
+    // Textura por código del FPG en O(1). El índice código -> posición se
+    // rehace tras invalidarlo o si textures cambia de tamaño o de
+    // almacenamiento. No es seguro llamarlo desde varios hilos a la vez.
+    const TextureEntry *findTexture(uint32_t code) const;
+    int textureIndex(uint32_t code) const;     // -1 si no está
+
+    // Elimina la región index. Las paredes que la usaban quedan sin esa región
+    // (-1) y las que apuntaban a regiones posteriores se renumeran, para que
+    // el mapa siga siendo válido al guardarlo y volver a abrirlo.
+    void eraseRegion(int index);
+
     // Declaraciones de métodos WLD
-    bool saveToWLD(const QString &filename);
-    bool loadFromWLD(const QString &filename);
+    QByteArray toWLDImage(const QString &filename) const;  // Imagen completa del fichero en memoria
+    // compressed: WLD en gzip; si cancel pasa a true antes de confirmar, no se toca el fichero.
+    // written recibe los bytes exactos que quedaron en disco.
+    bool saveToWLD(const QString &filename, bool compressed = false,
+                   const std::atomic<bool> *cancel = nullptr, QByteArray *written = nullptr) const;
+    // fileCrc/fileSize reciben el CRC32 y tamaño de los bytes que se leyeron
+    bool loadFromWLD(const QString &filename, ParseError *error = nullptr,
+                     uint32_t *fileCrc = nullptr, int32_t *fileSize = nullptr);
+
+    // Exporta el formato DAT del motor (map_save de divmap3d). Conviene llamar
+    // antes a assignRegionsAndPortals. Si algún valor no cabe en M8SHORT no se
+    // escribe nada y overflows recibe la lista de valores afectados.
+    bool saveToDAT(const QString &filename, QStringList *overflows = nullptr) const;
+
+    // Profundidad de regiones y portales (como map_asignregions de divmap3d)
+    void assignRegionsAndPortals();
+    void sortRegionsByDepth();
+    static bool wallsShareVertices(const ModernWall &w1, const ModernWall &w2);
+    static bool wallsHaveOppositeOrientation(const ModernWall &w1, const ModernWall &w2);
+    static bool isPointInRegion(qreal x, qreal y, const std::vector<QPointF> &polygon);
+
+private:
+    void rebuildTextureIndex() const;
+
+    mutable QHash<uint32_t, int> textureByCode;
+    mutable bool textureIndexValid = false;
+    mutable const TextureEntry *indexedData = nullptr;
+    mutable int indexedCount = -1;
 };
 
 // Estructuras para formato .tex
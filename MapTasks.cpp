@@ -0,0 +1,95 @@
+#include "MapTasks.h"
+#include "MapTrace.h"
+#include "FPGWriter.h"
+
+MapLoadResult loadMapTask(const QString &filename, std::shared_ptr<TaskControl> control) {
+    MAP_TRACE_SPAN(lcLoad, "loadMapTask");
+    MapLoadResult result;
+    result.map = std::make_shared<ModernMap>();
+
+    // Lectura: primera mitad del progreso. La clave del .wldx sale de los
+    // mismos bytes que se leyeron, no de volver a abrir el fichero.
+    if (!result.map->loadFromWLD(filename, &result.error, &result.key.crc, &result.key.size)) return result;
+    control->progress = 50;
+
+    if (control->cancelled) {
+        result.cancelled = true;
+        return result;
+    }
+
+    // Geometría derivada: del .wldx si corresponde a este WLD, si no se calcula
+    MapSidecar sidecar;
+    if (sidecar.open(filename, result.key)) {
+        result.geometry = sidecar.geometry();
+    } else {
+        result.sidecarStale = true;
+        result.geometry = MapGeometry::build(*result.map, &control->cancelled,
+                                             [&](int percent) { control->progress = 50 + percent / 2; });
+    }
+    if (control->cancelled) {
+        result.cancelled = true;
+        return result;
+    }
+
+    result.ok = true;
+    control->progress = 100;
+    return result;
+}
+
+MapSaveResult saveMapTask(std::shared_ptr<const ModernMap> snapshot, const QString &filename,
+                          bool compressed, std::shared_ptr<TaskControl> control) {
+    MapSaveResult result;
+    QByteArray written;
+    result.ok = snapshot->saveToWLD(filename, compressed, &control->cancelled, &written);
+    if (result.ok) result.key = MapSidecar::keyOf(written);
+    control->progress = 100;
+    return result;
+}
+
+FPGLoadResult loadFPGTask(const QString &filename, std::shared_ptr<TaskControl> control) {
+    MAP_TRACE_SPAN(lcLoad, "loadFPGTask");
+    FPGLoadResult result;
+    result.source = std::make_shared<FPGTextureSource>();
+
+    // Descompresión e índice de chunks: nada se decodifica todavía. Los
+    // duplicados y las miniaturas se buscan después, con la lista ya visible.
+    const bool ok = result.source->open(filename, &result.error, &control->cancelled,
+                                        [&](int percent) { control->progress = percent; });
+    if (control->cancelled) {
+        result.cancelled = true;
+        return result;
+    }
+    if (!ok) return result;
+
+    result.ok = true;
+    control->progress = 100;
+    return result;
+}
+
+FPGSaveResult saveFPGTask(const QVector<TextureEntry> &textures, const QString &filename,
+                          bool compressed, std::shared_ptr<TaskControl> control) {
+    MAP_TRACE_SPAN(lcLoad, "saveFPGTask");
+    FPGSaveResult result;
+    FPGWriter writer;
+    if (!writer.addTextures(textures)) {
+        result.mixedSources = true;
+        return result;
+    }
+    control->progress = 10;
+
+    result.chunks = writer.chunkCount();
+    result.ok = writer.save(filename, compressed, &control->cancelled);
+    control->progress = 100;
+    return result;
+}
+
+void buildThumbnailsTask(std::shared_ptr<FPGTextureSource> source, std::shared_ptr<TaskControl> control) {
+    source->findDuplicates(&control->cancelled, [&](int percent) { control->progress = percent / 4; });
+    if (control->cancelled) return;
+    source->buildThumbnails(&control->cancelled,
+                            [&](int percent) { control->progress = 25 + percent * 3 / 4; },
+                            [&](int chunks) { control->itemsReady = chunks; });
+    if (control->cancelled) return;
+    control->itemsReady = source->chunks().size();
+    control->progress = 100;
+}
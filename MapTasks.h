@@ -0,0 +1,57 @@
+#ifndef MAPTASKS_H
+#define MAPTASKS_H
+
+#include <QString>
+#include <atomic>
+#include <memory>
+#include "MapStructures.h"
+#include "MapGeometry.h"
+#include "MapSidecar.h"
+#include "FPGTextureSource.h"
+
+// Estado compartido entre la GUI y una tarea en segundo plano.
+// La GUI lee progress y puede activar cancelled en cualquier momento.
+struct TaskControl {
+    std::atomic<bool> cancelled{false};
+    std::atomic<int> progress{0};       // 0-100
+    std::atomic<int> itemsReady{0};     // Resultados parciales ya utilizables (p. ej. miniaturas)
+};
+
+struct MapLoadResult {
+    bool ok = false;
+    bool cancelled = false;
+    ParseError error;
+    std::shared_ptr<ModernMap> map;
+    MapGeometry geometry;
+    bool sidecarStale = false;          // No había .wldx válido: la geometría se calculó
+    MapSidecar::Key key;                // Clave del fichero leído, para regenerar el .wldx
+};
+
+struct MapSaveResult {
+    bool ok = false;
+    MapSidecar::Key key;                // De los bytes escritos, no del fichero releído
+};
+
+struct FPGLoadResult {
+    bool ok = false;
+    bool cancelled = false;
+    ParseError error;
+    std::shared_ptr<FPGTextureSource> source;
+};
+
+struct FPGSaveResult {
+    bool ok = false;
+    bool mixedSources = false;          // Texturas de FPG con distinta profundidad o paleta
+    int chunks = 0;
+};
+
+// Se ejecutan en un hilo de trabajo (QtConcurrent::run); no tocan la GUI.
+MapLoadResult loadMapTask(const QString &filename, std::shared_ptr<TaskControl> control);
+MapSaveResult saveMapTask(std::shared_ptr<const ModernMap> snapshot, const QString &filename,
+                          bool compressed, std::shared_ptr<TaskControl> control);
+FPGLoadResult loadFPGTask(const QString &filename, std::shared_ptr<TaskControl> control);
+FPGSaveResult saveFPGTask(const QVector<TextureEntry> &textures, const QString &filename,
+                          bool compressed, std::shared_ptr<TaskControl> control);
+void buildThumbnailsTask(std::shared_ptr<FPGTextureSource> source, std::shared_ptr<TaskControl> control);
+
+#endif // MAPTASKS_H
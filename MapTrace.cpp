@@ -0,0 +1,218 @@
+#include "MapTrace.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QVector>
+#include <algorithm>
+#include <memory>
+
+// Con QtInfoMsg como mínimo, qCDebug y los TraceSpan no hacen nada hasta que
+// una regla los activa
+Q_LOGGING_CATEGORY(lcLoad, "mapsector.load", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcDecode, "mapsector.decode", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcInflate, "mapsector.inflate", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcGeometry, "mapsector.geometry", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcScene, "mapsector.scene", QtInfoMsg)
+
+std::atomic<bool> TraceRecorder::enabled{false};
+
+namespace {
+
+struct TraceEvent {
+    const char *category;   // Literales y nombres de categoría: viven todo el programa
+    const char *name;
+    qint64 startNs;
+    qint64 durationNs;
+    int tid;
+};
+
+// Un búfer circular por hilo: record() sólo toma el cerrojo de su propio
+// hilo, que nadie más pide salvo al escribir la traza, así que registrar no
+// serializa los hilos que se están midiendo. next es el total de eventos
+// registrados en ese hilo desde start().
+struct ThreadBuffer {
+    QMutex mutex;
+    QVector<TraceEvent> events;
+    quint64 next = 0;
+    quint64 generation = 0;
+};
+
+// Registro de los búferes de todos los hilos; generation cambia en cada
+// start() para que cada hilo cree uno nuevo
+struct TraceBuffer {
+    QMutex mutex;
+    QVector<std::shared_ptr<ThreadBuffer>> threads;
+    int capacity = TraceRecorder::DefaultCapacity;
+    std::atomic<quint64> generation{0};
+    QString outputFile;
+};
+
+TraceBuffer &traceBuffer() {
+    static TraceBuffer buffer;
+    return buffer;
+}
+
+ThreadBuffer &threadBuffer() {
+    thread_local std::shared_ptr<ThreadBuffer> local;
+    TraceBuffer &buffer = traceBuffer();
+    const quint64 generation = buffer.generation.load(std::memory_order_acquire);
+    if (!local || local->generation != generation) {
+        QMutexLocker locker(&buffer.mutex);
+        local = std::make_shared<ThreadBuffer>();
+        local->events.resize(buffer.capacity);
+        local->generation = generation;
+        buffer.threads.append(local);
+    }
+    return *local;
+}
+
+const QElapsedTimer &traceClock() {
+    static const QElapsedTimer clock = [] {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock;
+}
+
+// Identificadores de hilo pequeños y estables; el 1 es el primero que
+// registra (normalmente el principal)
+int currentTid() {
+    static std::atomic<int> nextTid{1};
+    thread_local const int tid = nextTid++;
+    return tid;
+}
+
+void writeTraceAtExit() {
+    TraceBuffer &buffer = traceBuffer();
+    QString output;
+    {
+        QMutexLocker locker(&buffer.mutex);
+        output = buffer.outputFile;
+    }
+    if (output.isEmpty()) return;
+    if (!TraceRecorder::writeChromeTrace(output)) {
+        qWarning() << "No se pudo escribir la traza" << output;
+    }
+}
+
+} // namespace
+
+void TraceRecorder::start(int capacity) {
+    TraceBuffer &buffer = traceBuffer();
+    QMutexLocker locker(&buffer.mutex);
+    buffer.threads.clear();
+    buffer.capacity = qMax(capacity, 1);
+    buffer.generation++;
+    traceClock();
+    currentTid();
+    enabled = true;
+}
+
+void TraceRecorder::stop() {
+    enabled = false;
+}
+
+bool TraceRecorder::startFromEnvironment() {
+    const QString output = qEnvironmentVariable("MAPSECTOR_TRACE");
+    if (output.isEmpty()) return false;
+#ifdef MAPSECTOR_NO_TRACE
+    // Sin MAP_TRACE_SPAN compilados la traza saldría vacía
+    qWarning() << "MAPSECTOR_TRACE se ignora: compilado con MAPSECTOR_ENABLE_TRACING=OFF";
+    return false;
+#else
+    start();
+    {
+        TraceBuffer &buffer = traceBuffer();
+        QMutexLocker locker(&buffer.mutex);
+        buffer.outputFile = output;
+    }
+    qAddPostRoutine(writeTraceAtExit);
+    return true;
+#endif
+}
+
+qint64 TraceRecorder::now() {
+    return traceClock().nsecsElapsed();
+}
+
+void TraceRecorder::record(const char *category, const char *name, qint64 startNs, qint64 durationNs) {
+    const int tid = currentTid();
+    ThreadBuffer &buffer = threadBuffer();
+    QMutexLocker locker(&buffer.mutex);
+    buffer.events[int(buffer.next % quint64(buffer.events.size()))] = {category, name, startNs, durationNs, tid};
+    buffer.next++;
+}
+
+bool TraceRecorder::writeChromeTrace(const QString &filename) {
+    // Copia de cada hilo bajo su cerrojo; el JSON se genera sin bloquear a
+    // los hilos que siguen registrando
+    QVector<std::shared_ptr<ThreadBuffer>> threads;
+    {
+        TraceBuffer &buffer = traceBuffer();
+        QMutexLocker locker(&buffer.mutex);
+        threads = buffer.threads;
+    }
+    QVector<TraceEvent> events;
+    for (const std::shared_ptr<ThreadBuffer> &thread : threads) {
+        QMutexLocker locker(&thread->mutex);
+        const quint64 capacity = quint64(thread->events.size());
+        const quint64 first = thread->next > capacity ? thread->next - capacity : 0;
+        for (quint64 i = first; i < thread->next; i++) events.append(thread->events[int(i % capacity)]);
+    }
+    std::sort(events.begin(), events.end(),
+              [](const TraceEvent &a, const TraceEvent &b) { return a.startNs < b.startNs; });
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray traceEvents;
+
+    QJsonObject process;
+    process["name"] = "process_name";
+    process["ph"] = "M";
+    process["pid"] = pid;
+    process["args"] = QJsonObject{{"name", QCoreApplication::applicationName()}};
+    traceEvents.append(process);
+
+    // ts y dur en microsegundos, con decimales para no perder los intervalos cortos
+    for (const TraceEvent &event : events) {
+        QJsonObject object;
+        object["name"] = QString::fromLatin1(event.name);
+        object["cat"] = QString::fromLatin1(event.category);
+        object["ph"] = "X";
+        object["ts"] = event.startNs / 1000.0;
+        object["dur"] = event.durationNs / 1000.0;
+        object["pid"] = pid;
+        object["tid"] = event.tid;
+        traceEvents.append(object);
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = traceEvents;
+    root["displayTimeUnit"] = "ms";
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    const QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Compact);
+    if (file.write(json) != json.size()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+void TraceSpan::finish() {
+    const qint64 durationNs = TraceRecorder::now() - startNs;
+    if (TraceRecorder::isEnabled()) {
+        TraceRecorder::record(category->categoryName(), name, startNs, durationNs);
+    }
+    if (category->isDebugEnabled()) {
+        QMessageLogger().debug(*category).noquote()
+            << name << QString::number(durationNs / 1e6, 'f', 2) << "ms";
+    }
+}
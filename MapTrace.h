@@ -0,0 +1,84 @@
+#ifndef MAPTRACE_H
+#define MAPTRACE_H
+
+#include <QLoggingCategory>
+#include <QString>
+#include <atomic>
+
+// Categorías de trazas de tiempos, desactivadas por defecto. Se activan sin
+// recompilar con QT_LOGGING_RULES, p. ej. "mapsector.*.debug=true" o sólo
+// "mapsector.inflate.debug=true".
+Q_DECLARE_LOGGING_CATEGORY(lcLoad)       // Lectura de WLD y FPG
+Q_DECLARE_LOGGING_CATEGORY(lcDecode)     // Píxeles de chunks y miniaturas
+Q_DECLARE_LOGGING_CATEGORY(lcInflate)    // Descompresión gzip
+Q_DECLARE_LOGGING_CATEGORY(lcGeometry)   // Regiones, portales, profundidad y .wldx
+Q_DECLARE_LOGGING_CATEGORY(lcScene)      // Construcción de la escena del editor
+
+// Registro de intervalos en un búfer circular para exportarlos como JSON de
+// trace events de Chrome (chrome://tracing, ui.perfetto.dev). Se activa con
+// MAPSECTOR_TRACE=fichero.json: el fichero se escribe al salir de la
+// aplicación, con la GUI o con MapSectorCli.
+class TraceRecorder {
+public:
+    static const int DefaultCapacity = 1 << 16;   // Eventos por hilo; al llenarse se pisan los más antiguos
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // Empieza a registrar (y vacía el búfer)
+    static void start(int capacity = DefaultCapacity);
+    static void stop();
+
+    // Lee MAPSECTOR_TRACE; si está definida, registra y escribe el fichero
+    // cuando se destruye QCoreApplication. Llamar después de crearla. Con
+    // MAPSECTOR_NO_TRACE avisa y no hace nada.
+    static bool startFromEnvironment();
+
+    // Nanosegundos desde el origen común de todos los intervalos
+    static qint64 now();
+    static void record(const char *category, const char *name, qint64 startNs, qint64 durationNs);
+
+    // Eventos "X" (completos) con pid y tid de todos los hilos, del más
+    // antiguo al más reciente
+    static bool writeChromeTrace(const QString &filename);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+// Intervalo medido desde la construcción hasta el final del ámbito. Con la
+// categoría desactivada y sin TraceRecorder sólo se comprueban dos flags: no
+// se lee el reloj ni se formatea nada, así que se puede dejar en bucles
+// calientes.
+class TraceSpan {
+public:
+    TraceSpan(const QLoggingCategory &category, const char *name)
+        : category(category.isDebugEnabled() || TraceRecorder::isEnabled() ? &category : nullptr),
+          name(name) {
+        if (this->category) startNs = TraceRecorder::now();
+    }
+    ~TraceSpan() {
+        if (category) finish();
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    void finish();
+
+    const QLoggingCategory *category;
+    const char *name;
+    qint64 startNs = 0;
+};
+
+// MAP_TRACE_SPAN(lcLoad, "ModernMap::loadFromWLD"); al principio de la fase.
+// Compilando con MAPSECTOR_NO_TRACE desaparece por completo.
+#ifdef MAPSECTOR_NO_TRACE
+#define MAP_TRACE_SPAN(category, name) do {} while (0)
+#else
+#define MAP_TRACE_CONCAT_(a, b) a##b
+#define MAP_TRACE_CONCAT(a, b) MAP_TRACE_CONCAT_(a, b)
+#define MAP_TRACE_SPAN(category, name) TraceSpan MAP_TRACE_CONCAT(traceSpan_, __LINE__)(category(), name)
+#endif
+
+#endif // MAPTRACE_H
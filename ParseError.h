@@ -0,0 +1,16 @@
+#ifndef PARSEERROR_H
+#define PARSEERROR_H
+
+#include <QString>
+
+// Error de lectura de un fichero (WLD, FPG...): posición y motivo
+struct ParseError {
+    qint64 offset = -1;   // -1 si el error no corresponde a una posición concreta
+    QString reason;
+
+    QString toString() const {
+        return offset < 0 ? reason : QString("offset %1: %2").arg(offset).arg(reason);
+    }
+};
+
+#endif // PARSEERROR_H
@@ -0,0 +1,182 @@
+#include "ThumbnailStore.h"
+#include "GzipUtils.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <cstring>
+
+const int ThumbnailStore::LevelSizes[ThumbnailStore::LevelCount] = {16, 32, 64, 128};
+
+// Cabecera: magic + tamaño y fecha del FPG + número de chunks; después, en
+// gzip, por chunk el código y por nivel ancho, alto y píxeles premultiplicados
+static const char CacheMagic[8] = {'f', 'p', 'g', 't', '\x1a', '\x0d', '\x0a', '\x01'};
+static const int CacheHeaderSize = 8 + 8 + 8 + 4;
+
+void ThumbnailStore::reset(int chunkCount) {
+    QMutexLocker locker(&mutex);
+    pyramids.clear();
+    pyramids.resize(chunkCount);
+}
+
+int ThumbnailStore::count() const {
+    QMutexLocker locker(&mutex);
+    return pyramids.size();
+}
+
+bool ThumbnailStore::contains(int chunk) const {
+    QMutexLocker locker(&mutex);
+    return chunk >= 0 && chunk < pyramids.size() && pyramids[chunk].built;
+}
+
+void ThumbnailStore::build(int chunk, const QImage &full) {
+    if (full.isNull()) return;
+
+    // Del mayor al menor, cada uno desde el anterior
+    Pyramid pyramid;
+    QImage previous = full;
+    for (int level = LevelCount - 1; level >= 0; level--) {
+        const int side = LevelSizes[level];
+        previous = previous.scaled(side, side, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+                       .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        pyramid.levels[level] = previous;
+    }
+    pyramid.built = true;
+
+    QMutexLocker locker(&mutex);
+    if (chunk >= 0 && chunk < pyramids.size()) pyramids[chunk] = pyramid;
+}
+
+void ThumbnailStore::share(int chunk, int from) {
+    QMutexLocker locker(&mutex);
+    if (chunk < 0 || chunk >= pyramids.size() || from < 0 || from >= pyramids.size()) return;
+    if (pyramids[from].built) pyramids[chunk] = pyramids[from];
+}
+
+QImage ThumbnailStore::thumbnail(int chunk, int size) const {
+    int level = 0;
+    while (level < LevelCount - 1 && LevelSizes[level] < size) level++;
+
+    QImage image;
+    {
+        QMutexLocker locker(&mutex);
+        if (chunk < 0 || chunk >= pyramids.size() || !pyramids[chunk].built) return QImage();
+        image = pyramids[chunk].levels[level];
+    }
+
+    if (LevelSizes[level] > size) {
+        image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+}
+
+bool ThumbnailStore::isComplete() const {
+    QMutexLocker locker(&mutex);
+    for (const Pyramid &pyramid : pyramids) {
+        if (!pyramid.built) return false;
+    }
+    return true;
+}
+
+bool ThumbnailStore::load(const QString &cacheFile, const SourceKey &key) {
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    const QByteArray bytes = file.readAll();
+    if (bytes.size() < CacheHeaderSize || memcmp(bytes.constData(), CacheMagic, 8) != 0) return false;
+
+    qint64 size, modified;
+    int32_t count;
+    memcpy(&size, bytes.constData() + 8, 8);
+    memcpy(&modified, bytes.constData() + 16, 8);
+    memcpy(&count, bytes.constData() + 24, 4);
+    if (size != key.size || modified != key.modified || count != key.codes.size()) return false;
+
+    QByteArray payload;
+    if (!gzipDecompress(bytes.constData() + CacheHeaderSize, bytes.size() - CacheHeaderSize, &payload)) {
+        return false;
+    }
+
+    // Se valida todo antes de tocar las pirámides actuales
+    QVector<Pyramid> loaded(count);
+    const char *data = payload.constData();
+    qint64 offset = 0;
+    for (int chunk = 0; chunk < count; chunk++) {
+        int32_t code;
+        if (offset + 4 > payload.size()) return false;
+        memcpy(&code, data + offset, 4);
+        offset += 4;
+        if (code != key.codes[chunk]) return false;
+
+        for (int level = 0; level < LevelCount; level++) {
+            int32_t width, height;
+            if (offset + 8 > payload.size()) return false;
+            memcpy(&width, data + offset, 4);
+            memcpy(&height, data + offset + 4, 4);
+            offset += 8;
+            if (width <= 0 || height <= 0 || width > LevelSizes[level] || height > LevelSizes[level]) return false;
+
+            const qint64 pixelBytes = qint64(width) * height * 4;
+            if (offset + pixelBytes > payload.size()) return false;
+            QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+            for (int y = 0; y < height; y++) {
+                memcpy(image.scanLine(y), data + offset + qint64(y) * width * 4, width * 4);
+            }
+            offset += pixelBytes;
+            loaded[chunk].levels[level] = image;
+        }
+        loaded[chunk].built = true;
+    }
+
+    QMutexLocker locker(&mutex);
+    pyramids = loaded;
+    return true;
+}
+
+bool ThumbnailStore::save(const QString &cacheFile, const SourceKey &key) const {
+    QByteArray payload;
+    {
+        QMutexLocker locker(&mutex);
+        if (pyramids.size() != key.codes.size()) return false;
+
+        qint64 total = 0;
+        for (const Pyramid &pyramid : pyramids) {
+            if (!pyramid.built) return false;
+            total += 4;
+            for (const QImage &image : pyramid.levels) total += 8 + qint64(image.width()) * image.height() * 4;
+        }
+        payload.reserve(int(total));
+
+        for (int chunk = 0; chunk < pyramids.size(); chunk++) {
+            const int32_t code = key.codes[chunk];
+            payload.append(reinterpret_cast<const char*>(&code), 4);
+            for (const QImage &image : pyramids[chunk].levels) {
+                const int32_t width = image.width(), height = image.height();
+                payload.append(reinterpret_cast<const char*>(&width), 4);
+                payload.append(reinterpret_cast<const char*>(&height), 4);
+                for (int y = 0; y < height; y++) {
+                    payload.append(reinterpret_cast<const char*>(image.constScanLine(y)), width * 4);
+                }
+            }
+        }
+    }
+
+    const QByteArray compressed = gzipCompress(payload.constData(), payload.size());
+    if (compressed.isEmpty()) return false;
+
+    char header[CacheHeaderSize];
+    const int32_t count = key.codes.size();
+    memcpy(header, CacheMagic, 8);
+    memcpy(header + 8, &key.size, 8);
+    memcpy(header + 16, &key.modified, 8);
+    memcpy(header + 24, &count, 4);
+
+    QDir().mkpath(QFileInfo(cacheFile).absolutePath());
+    QSaveFile out(cacheFile);
+    if (!out.open(QIODevice::WriteOnly)) return false;
+    if (out.write(header, CacheHeaderSize) != CacheHeaderSize || out.write(compressed) != compressed.size()) {
+        out.cancelWriting();
+        return false;
+    }
+    return out.commit();
+}
@@ -0,0 +1,57 @@
+#ifndef THUMBNAILSTORE_H
+#define THUMBNAILSTORE_H
+
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <cstdint>
+
+// Miniaturas de cada textura en varios tamaños (16, 32, 64 y 128 píxeles de
+// lado como máximo, conservando la proporción). Cada nivel se escala desde el
+// anterior, así que la textura completa sólo se recorre una vez. Se puede
+// rellenar desde varios hilos y consultar desde cualquiera.
+class ThumbnailStore {
+public:
+    static const int LevelCount = 4;
+    static const int LevelSizes[LevelCount];
+
+    void reset(int chunkCount);
+    int count() const;
+
+    bool contains(int chunk) const;
+
+    // Construye la pirámide de chunk a partir de la imagen completa
+    void build(int chunk, const QImage &full);
+
+    // chunk usa la misma pirámide que from (texturas idénticas); no copia píxeles
+    void share(int chunk, int from);
+
+    // Miniatura que cabe en size x size. Si size no es uno de los niveles se
+    // escala desde el nivel inmediatamente mayor. Nula si aún no se construyó.
+    QImage thumbnail(int chunk, int size) const;
+
+    bool isComplete() const;
+
+    // Caché en disco: un fichero compacto (gzip) por paquete. Va ligado al
+    // tamaño y la fecha de modificación del FPG y a la lista de códigos de sus
+    // chunks; si algo no coincide load() no carga nada.
+    struct SourceKey {
+        qint64 size = 0;
+        qint64 modified = 0;            // ms desde epoch
+        QVector<int32_t> codes;         // En el orden de los chunks
+    };
+    bool load(const QString &cacheFile, const SourceKey &key);
+    bool save(const QString &cacheFile, const SourceKey &key) const;
+
+private:
+    struct Pyramid {
+        bool built = false;
+        QImage levels[LevelCount];
+    };
+
+    mutable QMutex mutex;
+    QVector<Pyramid> pyramids;
+};
+
+#endif // THUMBNAILSTORE_H
@@ -0,0 +1,166 @@
+#include "WLDFile.h"
+#include "GzipUtils.h"
+#include <QByteArray>
+#include <zlib.h>
+#include <cstring>
+#include <cstddef>
+
+bool WLDFile::fail(ParseError *error, qint64 offset, const QString &reason) {
+    if (error) {
+        error->offset = offset;
+        error->reason = reason;
+    }
+    close();
+    return false;
+}
+
+bool WLDFile::open(const QString &filename, ParseError *error, bool checksum) {
+    close();
+
+    file.setFileName(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(error, -1, QString("No se pudo abrir: %1").arg(file.errorString()));
+
+    size = file.size();
+    data = size > 0 ? file.map(0, size) : nullptr;
+    if (!data)
+        return fail(error, -1, QString("No se pudo mapear: %1").arg(file.errorString()));
+
+    // Sobre los mismos bytes que se van a leer: releer el fichero podría dar
+    // otro contenido si lo reemplazan entretanto
+    if (checksum) {
+        rawSize = int32_t(size);
+        rawCrc = crc32(crc32(0L, Z_NULL, 0), data, uInt(size));
+    }
+
+    // WLD comprimido con gzip: se descomprime en memoria y se valida igual.
+    // Los offsets de error se refieren entonces a los datos descomprimidos.
+    if (isGzipData(reinterpret_cast<const char*>(data), size)) {
+        QByteArray decompressed;
+        bool ok = gzipDecompress(reinterpret_cast<const char*>(data), size, &decompressed);
+        const uint32_t crc = rawCrc;
+        const int32_t rawBytes = rawSize;
+        close();
+        rawCrc = crc;
+        rawSize = rawBytes;
+        if (!ok)
+            return fail(error, -1, "Datos gzip corruptos o truncados");
+
+        inflated = decompressed;
+        data = reinterpret_cast<const uchar*>(inflated.constData());
+        size = inflated.size();
+    }
+
+    if (size < PointsOffset + 4)
+        return fail(error, size, "Fichero truncado: falta la cabecera");
+
+    // Validar header
+    if (memcmp(data, "wld\x1a\x0d\x0a\x01\x00", 8) != 0)
+        return fail(error, 0, "Cabecera WLD inválida");
+
+    // total cuenta todo lo que sigue a magic + total (ver map_saveedit).
+    // map_save escribe la zona DAT a continuación en el mismo fichero, así
+    // que lo que quede detrás del bloque WLD se ignora.
+    int32_t total;
+    memcpy(&total, data + 8, 4);
+    if (total < 0 || total > size - HeaderSize)
+        return fail(error, 8, QString("Tamaño total %1 no cabe en el fichero (%2 bytes)")
+                                  .arg(total).arg(size - HeaderSize));
+    const qint64 end = HeaderSize + qint64(total);
+
+    // Cada contador se comprueba contra el máximo de divmap3d y contra los
+    // bytes que quedan en el fichero antes de exponer el array
+    qint64 offset = PointsOffset;
+    auto readSection = [&](const char *what, int32_t &count, int32_t maxCount,
+                           qint64 recordSize) -> const uchar* {
+        if (offset + 4 > end) {
+            fail(error, offset, QString("Fichero truncado: falta el número de %1").arg(what));
+            return nullptr;
+        }
+        memcpy(&count, data + offset, 4);
+        if (count < 0 || count > maxCount) {
+            fail(error, offset, QString("Número de %1 fuera de rango: %2 (máximo %3)")
+                                    .arg(what).arg(count).arg(maxCount));
+            return nullptr;
+        }
+        offset += 4;
+        if (count * recordSize > end - offset) {
+            fail(error, offset, QString("Fichero truncado: %1 %2 no caben en %3 bytes")
+                                    .arg(count).arg(what).arg(end - offset));
+            return nullptr;
+        }
+        const uchar *records = data + offset;
+        offset += count * recordSize;
+        return records;
+    };
+
+    int32_t numFlags = 0;
+    const uchar *p = readSection("puntos", numPoints, MAX_POINTS, sizeof(tpoint));
+    if (!p) return false;
+    const qint64 wallsOffset = offset + 4;
+    const uchar *w = readSection("paredes", numWalls, MAX_WALLS, sizeof(twall));
+    if (!w) return false;
+    const uchar *r = readSection("regiones", numRegions, MAX_REGIONS, sizeof(tregion));
+    if (!r) return false;
+    if (!readSection("flags", numFlags, MAX_FLAGS, sizeof(tflag))) return false;
+
+    if (offset + 4 > end)
+        return fail(error, offset, QString("Se esperaban 4 bytes de fondo y quedan %1").arg(end - offset));
+    memcpy(&fondoValue, data + offset, 4);
+
+    // Todos los offsets son múltiplos de 4 y el mapeo está alineado a página
+    pointsData = reinterpret_cast<const tpoint*>(p);
+    wallsData = reinterpret_cast<const twall*>(w);
+    regionsData = reinterpret_cast<const tregion*>(r);
+
+    return validateWalls(wallsOffset, error);
+}
+
+bool WLDFile::validateWalls(qint64 wallsOffset, ParseError *error) {
+    // Una sola pasada lineal: p1/p2 deben ser puntos existentes y las
+    // regiones deben existir o ser -1 (sin región)
+    for (int32_t i = 0; i < numWalls; i++) {
+        const twall &wall = wallsData[i];
+        const qint64 wallOffset = wallsOffset + i * qint64(sizeof(twall));
+
+        if (wall.p1 < 0 || wall.p1 >= numPoints)
+            return fail(error, wallOffset + offsetof(twall, p1),
+                        QString("Pared %1: punto p1=%2 fuera de rango").arg(i).arg(wall.p1));
+        if (wall.p2 < 0 || wall.p2 >= numPoints)
+            return fail(error, wallOffset + offsetof(twall, p2),
+                        QString("Pared %1: punto p2=%2 fuera de rango").arg(i).arg(wall.p2));
+        if (wall.front_region < -1 || wall.front_region >= numRegions)
+            return fail(error, wallOffset + offsetof(twall, front_region),
+                        QString("Pared %1: región frontal %2 fuera de rango").arg(i).arg(wall.front_region));
+        if (wall.back_region < -1 || wall.back_region >= numRegions)
+            return fail(error, wallOffset + offsetof(twall, back_region),
+                        QString("Pared %1: región trasera %2 fuera de rango").arg(i).arg(wall.back_region));
+    }
+    return true;
+}
+
+void WLDFile::close() {
+    if (data && inflated.isEmpty()) file.unmap(const_cast<uchar*>(data));
+    if (file.isOpen()) file.close();
+    inflated.clear();
+
+    data = nullptr;
+    size = 0;
+    numPoints = numWalls = numRegions = fondoValue = 0;
+    rawCrc = 0;
+    rawSize = 0;
+    pointsData = nullptr;
+    wallsData = nullptr;
+    regionsData = nullptr;
+}
+
+QString WLDFile::fixedString(int offset, int fieldSize) const {
+    if (!data) return QString();
+    const char *text = reinterpret_cast<const char*>(data + offset);
+    return QString::fromUtf8(text, qstrnlen(text, fieldSize));
+}
+
+QString WLDFile::m3dPath() const { return fixedString(M3DPathOffset, 256); }
+QString WLDFile::m3dName() const { return fixedString(M3DNameOffset, 16); }
+QString WLDFile::fpgPath() const { return fixedString(FPGPathOffset, 256); }
+QString WLDFile::fpgName() const { return fixedString(FPGNameOffset, 16); }
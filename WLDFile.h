@@ -0,0 +1,78 @@
+#ifndef WLDFILE_H
+#define WLDFILE_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+#include <cstdint>
+#include "divmap3d.hpp"
+#include "ParseError.h"
+
+// Vista de solo lectura sobre un fichero WLD mapeado en memoria.
+// Los arrays de tpoint/twall/tregion apuntan directamente al fichero,
+// sin copias ni lecturas por registro (o al buffer descomprimido si el
+// WLD está en gzip). open() valida todos los contadores y
+// las referencias pared->punto y pared->región antes de exponer nada.
+class WLDFile {
+public:
+    WLDFile() = default;
+    ~WLDFile() { close(); }
+
+    WLDFile(const WLDFile &) = delete;
+    WLDFile &operator=(const WLDFile &) = delete;
+
+    // Con checksum también se calcula el CRC32 de los bytes tal y como están
+    // en disco (antes de descomprimir), el mismo de MapJournal::fileChecksum
+    bool open(const QString &filename, ParseError *error = nullptr, bool checksum = false);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+
+    // Campos de la cabecera (bloque de rutas de 548 bytes)
+    QString m3dPath() const;
+    QString m3dName() const;
+    QString fpgPath() const;
+    QString fpgName() const;
+
+    int32_t pointCount() const { return numPoints; }
+    int32_t wallCount() const { return numWalls; }
+    int32_t regionCount() const { return numRegions; }
+    int32_t fondo() const { return fondoValue; }
+    uint32_t fileCrc() const { return rawCrc; }
+    int32_t fileSize() const { return rawSize; }
+
+    const tpoint *points() const { return pointsData; }
+    const twall *walls() const { return wallsData; }
+    const tregion *regions() const { return regionsData; }
+
+    // Offsets fijos del formato (como map_saveedit de divmap3d)
+    static const int HeaderSize = 8 + 4;        // magic + total
+    static const int PathBlockSize = 548;       // m3d_path, m3d_name, numero, fpg_path, fpg_name
+    static const int M3DPathOffset = 12;
+    static const int M3DNameOffset = 268;
+    static const int FPGPathOffset = 288;
+    static const int FPGNameOffset = 544;
+    static const int PointsOffset = HeaderSize + PathBlockSize;
+
+private:
+    QString fixedString(int offset, int fieldSize) const;
+    bool fail(ParseError *error, qint64 offset, const QString &reason);
+    bool validateWalls(qint64 wallsOffset, ParseError *error);
+
+    QFile file;
+    QByteArray inflated;              // Contenido descomprimido si el WLD venía en gzip
+    const uchar *data = nullptr;
+    qint64 size = 0;
+
+    int32_t numPoints = 0;
+    int32_t numWalls = 0;
+    int32_t numRegions = 0;
+    int32_t fondoValue = 0;
+    uint32_t rawCrc = 0;
+    int32_t rawSize = 0;
+
+    const tpoint *pointsData = nullptr;
+    const twall *wallsData = nullptr;
+    const tregion *regionsData = nullptr;
+};
+
+#endif // WLDFILE_H
@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "MapTrace.h"
 
 #include <QApplication>
 #include <QLocale>
@@ -8,6 +9,9 @@ int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    // MAPSECTOR_TRACE=traza.json: intervalos de tiempo para chrome://tracing
+    TraceRecorder::startFromEnvironment();
+
     QTranslator translator;
     const QStringList uiLanguages = QLocale::system().uiLanguages();
     for (const QString &locale : uiLanguages) {
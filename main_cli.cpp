@@ -0,0 +1,536 @@
+// Conversor/validador de mapas WLD por lotes, sin interfaz gráfica.
+// Cada mapa es una tarea independiente en el pool de hilos:
+// carga -> asignación de regiones/portales -> exportación.
+#include "MapStructures.h"
+#include "MapJournal.h"
+#include "MapLibrary.h"
+#include "MapSidecar.h"
+#include "FPGFile.h"
+#include "FPGWriter.h"
+#include "MapTrace.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <numeric>
+
+struct ConvertResult {
+    QString input;
+    bool ok = false;
+    QString error;
+    qint64 elapsedNs = 0;
+    int regions = 0;
+    int walls = 0;
+};
+
+struct ConvertOptions {
+    QString outputDir;      // vacío: sólo validar
+    bool compress = false;
+    bool dat = false;       // exportar el DAT del motor en lugar de WLD
+    bool sidecar = false;   // generar el .wldx junto a cada mapa de entrada
+};
+
+static QMutex outputMutex;
+
+// Reempaqueta un FPG copiando sus chunks tal cual; la compresión gzip ya
+// reparte los bloques entre todos los hilos
+static bool repackFPG(const QString &input, const QString &outputDir, bool compress) {
+    MAP_TRACE_SPAN(lcLoad, "repackFPG");
+    QElapsedTimer timer;
+    timer.start();
+
+    FPGFile fpg;
+    ParseError error;
+    if (!fpg.open(input, &error)) {
+        printf("ERROR %9.2f ms  %s: %s\n", timer.nsecsElapsed() / 1e6, qPrintable(input),
+               qPrintable(error.toString()));
+        return false;
+    }
+    for (const FPGChunkIssue &issue : fpg.issues()) {
+        printf("AVISO             %s: %s\n", qPrintable(input), qPrintable(issue.toString()));
+    }
+
+    FPGWriter writer;
+    if (!writer.addFile(fpg)) {
+        printf("ERROR %9.2f ms  %s: Demasiados datos para un solo FPG\n", timer.nsecsElapsed() / 1e6,
+               qPrintable(input));
+        return false;
+    }
+    const QString output = QDir(outputDir).filePath(QFileInfo(input).fileName());
+    if (!writer.save(output, compress)) {
+        printf("ERROR %9.2f ms  %s: No se pudo escribir %s\n", timer.nsecsElapsed() / 1e6,
+               qPrintable(input), qPrintable(output));
+        return false;
+    }
+
+    printf("OK    %9.2f ms  %s (%d chunks, %lld -> %lld bytes)\n", timer.nsecsElapsed() / 1e6,
+           qPrintable(input), writer.chunkCount(), QFileInfo(input).size(), QFileInfo(output).size());
+    fflush(stdout);
+    return true;
+}
+
+// Decodificación de referencia: intercambio BGRA -> RGBA byte a byte a
+// Format_RGBA8888, como hacía loadFPGFile antes de mapear a Format_ARGB32
+static QImage swizzleDecode(const uchar *src, int width, int height) {
+    QImage image(width, height, QImage::Format_RGBA8888);
+    const int rowBytes = width * 4;
+    for (int y = 0; y < height; y++, src += rowBytes) {
+        uchar *dst = image.scanLine(y);
+        for (int x = 0; x < rowBytes; x += 4) {
+            dst[x] = src[x + 2];
+            dst[x + 1] = src[x + 1];
+            dst[x + 2] = src[x];
+            dst[x + 3] = src[x + 3];
+        }
+    }
+    return image;
+}
+
+// FPG de 32 bits generado para el micro-benchmark: chunks cuadrados de 32x32
+// a 4096x4096 (de 1K a 16M píxeles, x4 cada vez), con contenido pseudoaleatorio para
+// que ninguna ruta rápida dependa de los datos. Se escribe fila a fila.
+static QString writeBenchFPG(const QString &dir) {
+    const QString path = QDir(dir).filePath("bench.fpg");
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return QString();
+    file.write("f32\x1a\x0d\x0a\x00\x00", FPGFile::HeaderSize);
+
+    uint32_t seed = 12345;
+    int code = 1;
+    for (int side = 32; side <= 4096; side *= 2, code++) {
+        FPG_CHUNK chunk = {};
+        chunk.code = code;
+        chunk.width = chunk.height = side;
+        qsnprintf(chunk.name, sizeof(chunk.name), "%dx%d", side, side);
+        file.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+
+        QByteArray row(side * 4, Qt::Uninitialized);
+        for (int y = 0; y < side; y++) {
+            uint32_t *pixel = reinterpret_cast<uint32_t*>(row.data());
+            for (int x = 0; x < side; x++) {
+                seed = seed * 1664525u + 1013904223u;
+                pixel[x] = seed;
+            }
+            if (file.write(row) != row.size()) return QString();
+        }
+    }
+    return path;
+}
+
+// Micro-benchmark de FPGFile::decode: tiempo por chunk y total, secuencial y
+// en paralelo. En 32 bits se compara con el intercambio de canales byte a byte.
+// Los chunks pequeños se decodifican varias veces y se da la media.
+static bool benchFPG(const QString &input) {
+    FPGFile fpg;
+    ParseError error;
+    if (!fpg.open(input, &error)) {
+        printf("ERROR %s: %s\n", qPrintable(input), qPrintable(error.toString()));
+        return false;
+    }
+
+    printf("%s: %d chunks de %d bits\n", qPrintable(input), fpg.chunkCount(), fpg.depth());
+    printf("%8s %11s %12s %12s %8s\n", "código", "píxeles", "decode ms", "swizzle ms", "Mpx/s");
+    QElapsedTimer timer;
+    qint64 pixels = 0, decodeNs = 0, swizzleNs = 0;
+    for (int i = 0; i < fpg.chunkCount(); i++) {
+        const FPGChunkInfo &info = fpg.chunks()[i];
+        const qint64 chunkPixels = qint64(info.width) * info.height;
+
+        // Unos 4M píxeles por medición como mínimo: en 1K píxeles una sola
+        // decodificación queda por debajo de la resolución del reloj
+        const int repeats = int(qBound<qint64>(1, (qint64(1) << 22) / qMax<qint64>(chunkPixels, 1), 4096));
+        QImage image;
+        timer.start();
+        for (int r = 0; r < repeats; r++) image = fpg.decode(i);
+        const qint64 ns = timer.nsecsElapsed() / repeats;
+
+        qint64 referenceNs = -1;
+        if (fpg.depth() == 32) {
+            qint64 length;
+            const uchar *bytes = fpg.chunkBytes(i, &length);
+            timer.start();
+            for (int r = 0; r < repeats; r++) {
+                const QImage reference = swizzleDecode(bytes + (info.pixelOffset - info.offset), info.width, info.height);
+            }
+            referenceNs = timer.nsecsElapsed() / repeats;
+            swizzleNs += referenceNs;
+        }
+
+        printf("%8d %11lld %12.3f %12.3f %8.1f\n", info.code, chunkPixels, ns / 1e6,
+               referenceNs < 0 ? 0.0 : referenceNs / 1e6, ns > 0 ? chunkPixels * 1e3 / ns : 0.0);
+        pixels += chunkPixels;
+        decodeNs += ns;
+        if (image.isNull()) printf("AVISO    código %d: no se pudo decodificar\n", info.code);
+    }
+
+    QVector<int> all(fpg.chunkCount());
+    std::iota(all.begin(), all.end(), 0);
+    timer.start();
+    fpg.decodeChunks(all);
+    const qint64 parallelNs = timer.nsecsElapsed();
+
+    printf("\nTotal %lld píxeles: decode %.2f ms (%.1f Mpx/s)", pixels, decodeNs / 1e6,
+           decodeNs > 0 ? pixels * 1e3 / decodeNs : 0.0);
+    if (fpg.depth() == 32) {
+        printf(", swizzle %.2f ms (x%.1f)", swizzleNs / 1e6, decodeNs > 0 ? double(swizzleNs) / decodeNs : 0.0);
+    }
+    printf("\nEn paralelo: %.2f ms con %d hilos\n", parallelNs / 1e6,
+           QThreadPool::globalInstance()->maxThreadCount());
+    fflush(stdout);
+    return true;
+}
+
+// Comprobaciones de lectura sobre ficheros generados al vuelo (ctest)
+static bool check(bool condition, const char *what) {
+    printf("%s %s\n", condition ? "OK   " : "ERROR", what);
+    return condition;
+}
+
+static int runSelfTest() {
+    QTemporaryDir dir;
+    if (!dir.isValid()) return 1;
+
+    // Una habitación cuadrada: 4 puntos, 4 paredes, 1 región
+    ModernMap map;
+    const int corners[4][2] = {{0, 0}, {256, 0}, {256, 256}, {0, 256}};
+    for (const auto &c : corners) map.points.push_back(ModernPoint(c[0], c[1]));
+    map.regions.resize(1);
+    map.regions[0].active = 1;
+    for (int i = 0; i < 4; i++) {
+        ModernWall wall;
+        wall.active = 1;
+        wall.p1 = i;
+        wall.p2 = (i + 1) % 4;
+        wall.front_region = 0;
+        map.walls.push_back(wall);
+    }
+
+    bool ok = true;
+    ModernMap loaded;
+    ParseError error;
+
+    // map_save: bloque WLD seguido de la zona DAT en el mismo fichero
+    const QString datPath = dir.filePath("map_save.dat");
+    ok &= check(map.saveToDAT(datPath), "saveToDAT escribe WLD + DAT");
+    ok &= check(loaded.loadFromWLD(datPath, &error) && loaded.walls.size() == 4 && loaded.points.size() == 4,
+                "loadFromWLD acepta la zona DAT detrás del bloque WLD");
+
+    // Un total mayor que el fichero sigue siendo un error
+    QByteArray image = map.toWLDImage(datPath);
+    const int32_t tooBig = image.size();
+    memcpy(image.data() + 8, &tooBig, 4);
+    QFile truncated(dir.filePath("truncated.wld"));
+    ok &= check(truncated.open(QIODevice::WriteOnly) && truncated.write(image) == image.size(),
+                "escribir WLD con total excesivo");
+    truncated.close();
+    ok &= check(!loaded.loadFromWLD(truncated.fileName(), &error), "loadFromWLD rechaza un total mayor que el fichero");
+
+    // Borrar la única región deja sus paredes sin región, no apuntando a una
+    // que ya no existe, y el fichero se vuelve a abrir
+    ModernMap erased = map;
+    erased.eraseRegion(0);
+    const QString erasedPath = dir.filePath("erased.wld");
+    ok &= check(erased.saveToWLD(erasedPath), "guardar mapa sin regiones");
+    ok &= check(loaded.loadFromWLD(erasedPath, &error) && loaded.regions.empty()
+                    && loaded.walls.size() == 4 && loaded.walls[0].front_region == -1,
+                "loadFromWLD abre el mapa tras eraseRegion");
+
+    // El .wldx y MapGeometry::build dan el mismo contorno de cada región
+    const QString ringPath = dir.filePath("ring.wld");
+    MapSidecar::Key ringKey;
+    ok &= check(map.saveToWLD(ringPath) && MapSidecar::currentKey(ringPath, &ringKey)
+                    && MapSidecar::write(ringPath, map, ringKey),
+                "escribir .wldx");
+    MapSidecar sidecar;
+    ok &= check(sidecar.open(ringPath, ringKey)
+                    && sidecar.geometry().regionPoints == MapGeometry::build(map).regionPoints,
+                "el .wldx y MapGeometry::build dan los mismos contornos");
+    sidecar.close();
+
+    // Ediciones hechas mientras se guardaba: el diario nuevo las lleva y
+    // replay las aplica sobre el fichero recién guardado
+    const QString journaledPath = dir.filePath("journaled.wld");
+    ok &= check(map.saveToWLD(journaledPath), "guardar mapa base del diario");
+    ModernMap edited = map;
+    edited.points[1].x = 512;
+    edited.points.push_back(ModernPoint(128, 128));
+    edited.walls[2].texture = 7;
+    edited.eraseRegion(0);
+    {
+        MapJournal journal;
+        ok &= check(journal.start(journaledPath, map, edited), "diario con ediciones pendientes");
+    }
+    ok &= check(loaded.loadFromWLD(journaledPath, &error) && MapJournal::replay(journaledPath, loaded) > 0
+                    && loaded.toWLDImage(journaledPath) == edited.toWLDImage(journaledPath),
+                "replay reproduce las ediciones pendientes");
+
+    // FPG con una cabecera basura: ancho * alto * 4 desborda
+    QByteArray fpgBytes("f32\x1a\x0d\x0a\x00\x00", FPGFile::HeaderSize);
+    FPG_CHUNK garbage = {};
+    garbage.code = 1;
+    garbage.width = garbage.height = 0x7fffffff;
+    fpgBytes.append(reinterpret_cast<const char*>(&garbage), sizeof(garbage));
+    fpgBytes.append(QByteArray(64, '\0'));
+    QFile garbageFile(dir.filePath("garbage.fpg"));
+    ok &= check(garbageFile.open(QIODevice::WriteOnly) && garbageFile.write(fpgBytes) == fpgBytes.size(),
+                "escribir FPG con cabecera basura");
+    garbageFile.close();
+    FPGFile fpg;
+    ok &= check(fpg.open(garbageFile.fileName(), &error) && fpg.chunkCount() == 0 && !fpg.issues().isEmpty(),
+                "FPGFile omite un chunk cuyo tamaño desborda");
+
+    // Un chunk más ancho que el máximo de QImage no se indexa para dibujar,
+    // pero el reempaquetado lo copia igual
+    QByteArray wideBytes("f32\x1a\x0d\x0a\x00\x00", FPGFile::HeaderSize);
+    FPG_CHUNK wide = {};
+    wide.code = 2;
+    wide.width = 40000;
+    wide.height = 1;
+    wideBytes.append(reinterpret_cast<const char*>(&wide), sizeof(wide));
+    wideBytes.append(QByteArray(wide.width * 4, '\x7f'));
+    QFile wideFile(dir.filePath("wide.fpg"));
+    ok &= check(wideFile.open(QIODevice::WriteOnly) && wideFile.write(wideBytes) == wideBytes.size(),
+                "escribir FPG con un chunk muy ancho");
+    wideFile.close();
+    FPGWriter writer;
+    ok &= check(fpg.open(wideFile.fileName(), &error) && fpg.chunkCount() == 0 && fpg.storedChunks().size() == 1
+                    && writer.addFile(fpg) && writer.chunkCount() == 1 && writer.size() == wideBytes.size(),
+                "el reempaquetado conserva los chunks que no caben en una QImage");
+
+    // Premultiplicar al copiar da lo mismo que convertir después
+    QByteArray alphaBytes("f32\x1a\x0d\x0a\x00\x00", FPGFile::HeaderSize);
+    FPG_CHUNK alpha = {};
+    alpha.code = 3;
+    alpha.width = 3;
+    alpha.height = 1;
+    alphaBytes.append(reinterpret_cast<const char*>(&alpha), sizeof(alpha));
+    const uchar alphaPixels[12] = {200, 100, 50, 128,  10, 20, 30, 255,  90, 90, 90, 0};
+    alphaBytes.append(reinterpret_cast<const char*>(alphaPixels), sizeof(alphaPixels));
+    QFile alphaFile(dir.filePath("alpha.fpg"));
+    ok &= check(alphaFile.open(QIODevice::WriteOnly) && alphaFile.write(alphaBytes) == alphaBytes.size(),
+                "escribir FPG con transparencias");
+    alphaFile.close();
+    ok &= check(fpg.open(alphaFile.fileName(), &error) && fpg.chunkCount() == 1
+                    && fpg.decode(0, true) == fpg.decode(0).convertToFormat(QImage::Format_ARGB32_Premultiplied),
+                "decode premultiplicado coincide con convertToFormat");
+
+    return ok ? 0 : 2;
+}
+
+static ConvertResult convertMap(const QString &input, const ConvertOptions &options) {
+    MAP_TRACE_SPAN(lcLoad, "convertMap");
+    ConvertResult result;
+    result.input = input;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    ModernMap map;
+    ParseError parseError;
+    MapSidecar::Key key;
+    if (!map.loadFromWLD(input, &parseError, &key.crc, &key.size)) {
+        result.error = parseError.toString();
+    } else {
+        // Con un .wldx válido se evita el cálculo cuadrático de portales
+        MapSidecar sidecar;
+        const bool fresh = sidecar.open(input, key);
+        if (options.sidecar && !fresh) MapSidecar::write(input, map, key);
+        if (!fresh || !sidecar.applyRegionsAndPortals(map)) map.assignRegionsAndPortals();
+        sidecar.close();
+
+        result.regions = map.regions.size();
+        result.walls = map.walls.size();
+
+        if (options.outputDir.isEmpty()) {
+            result.ok = true;
+        } else {
+            QFileInfo info(input);
+            if (options.dat) {
+                QString output = QDir(options.outputDir).filePath(info.completeBaseName() + ".dat");
+                QStringList overflows;
+                result.ok = map.saveToDAT(output, &overflows);
+                if (!result.ok) {
+                    result.error = overflows.isEmpty() ? QString("No se pudo escribir %1").arg(output)
+                                                       : "Valores fuera de M8SHORT: " + overflows.join("; ");
+                }
+            } else {
+                QString output = QDir(options.outputDir).filePath(info.fileName());
+                result.ok = map.saveToWLD(output, options.compress);
+                if (!result.ok) result.error = QString("No se pudo escribir %1").arg(output);
+            }
+        }
+    }
+
+    result.elapsedNs = timer.nsecsElapsed();
+
+    // Una línea por fichero en cuanto termina
+    QMutexLocker locker(&outputMutex);
+    if (result.ok) {
+        printf("OK    %9.2f ms  %s (%d regiones, %d paredes)\n", result.elapsedNs / 1e6,
+               qPrintable(input), result.regions, result.walls);
+    } else {
+        printf("ERROR %9.2f ms  %s: %s\n", result.elapsedNs / 1e6,
+               qPrintable(input), qPrintable(result.error));
+    }
+    fflush(stdout);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("MapSectorCli");
+    TraceRecorder::startFromEnvironment();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Valida y convierte mapas WLD en paralelo\n"
+                                     "Con MAPSECTOR_TRACE=traza.json se guardan los tiempos para chrome://tracing");
+    parser.addHelpOption();
+    parser.addPositionalArgument("entradas", "Ficheros .wld o directorios que los contengan", "<entradas...>");
+    QCommandLineOption outputOption({"o", "output-dir"}, "Directorio de salida (sin él sólo se valida)", "dir");
+    QCommandLineOption compressOption({"z", "compress"}, "Guardar los WLD (o FPG) comprimidos con gzip");
+    QCommandLineOption datOption("dat", "Exportar el formato DAT del motor en lugar de WLD");
+    QCommandLineOption sidecarOption("wldx", "Generar el .wldx de geometría junto a cada mapa");
+    QCommandLineOption repackOption("repack-fpg", "Reempaquetar ficheros .fpg en el directorio de salida (con -z, en gzip)");
+    QCommandLineOption jobsOption({"j", "jobs"}, "Número de hilos (por defecto, todos los núcleos)", "n");
+    parser.addOption(outputOption);
+    parser.addOption(compressOption);
+    parser.addOption(datOption);
+    QCommandLineOption textureOption("uses-texture", "Listar los mapas que usan el código de textura", "codigo");
+    QCommandLineOption sizeOption("larger-than", "Listar los mapas cuya caja supera ANCHOxALTO", "tam");
+    QCommandLineOption fpgOption("uses-fpg", "Listar los mapas que referencian el FPG", "nombre");
+    parser.addOption(sidecarOption);
+    parser.addOption(repackOption);
+    parser.addOption(jobsOption);
+    parser.addOption(textureOption);
+    parser.addOption(sizeOption);
+    parser.addOption(fpgOption);
+    QCommandLineOption selfTestOption("self-test", "Comprobar la lectura de ficheros generados al vuelo");
+    QCommandLineOption benchOption("bench-fpg", "Medir la decodificación de chunks generados de 1K a 16M píxeles y de los .fpg de entrada");
+    parser.addOption(selfTestOption);
+    parser.addOption(benchOption);
+    parser.process(app);
+
+    if (parser.isSet(selfTestOption)) return runSelfTest();
+
+    // Expandir directorios a sus .wld (o .fpg al reempaquetar o medir)
+    const bool repack = parser.isSet(repackOption);
+    const bool bench = parser.isSet(benchOption);
+    const QStringList patterns = repack || bench ? QStringList{"*.fpg", "*.FPG"} : QStringList{"*.wld", "*.WLD"};
+    QStringList inputs;
+    for (const QString &arg : parser.positionalArguments()) {
+        if (QFileInfo(arg).isDir()) {
+            QDirIterator it(arg, patterns, QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext()) inputs << it.next();
+        } else {
+            inputs << arg;
+        }
+    }
+    if (inputs.isEmpty() && !bench) {
+        parser.showHelp(1);
+    }
+
+    ConvertOptions options;
+    options.outputDir = parser.value(outputOption);
+    options.compress = parser.isSet(compressOption);
+    options.dat = parser.isSet(datOption);
+    options.sidecar = parser.isSet(sidecarOption);
+    if (!options.outputDir.isEmpty() && !QDir().mkpath(options.outputDir)) {
+        fprintf(stderr, "No se pudo crear %s\n", qPrintable(options.outputDir));
+        return 1;
+    }
+    if (parser.isSet(jobsOption)) {
+        QThreadPool::globalInstance()->setMaxThreadCount(qMax(1, parser.value(jobsOption).toInt()));
+    }
+
+    QElapsedTimer wallClock;
+    wallClock.start();
+
+    if (bench) {
+        // Siempre primero el FPG generado, para que el resultado no dependa
+        // de los paquetes que haya a mano; después los indicados
+        QTemporaryDir benchDir;
+        const QString generated = benchDir.isValid() ? writeBenchFPG(benchDir.path()) : QString();
+        if (generated.isEmpty()) {
+            fprintf(stderr, "No se pudo generar el FPG de prueba\n");
+            return 1;
+        }
+        int failed = benchFPG(generated) ? 0 : 1;
+        for (const QString &input : inputs) {
+            if (!benchFPG(input)) failed++;
+        }
+        return failed == 0 ? 0 : 2;
+    }
+
+    if (repack) {
+        if (options.outputDir.isEmpty()) {
+            fprintf(stderr, "--repack-fpg necesita --output-dir\n");
+            return 1;
+        }
+        int failed = 0;
+        for (const QString &input : inputs) {
+            if (!repackFPG(input, options.outputDir, options.compress)) failed++;
+        }
+        printf("\n%d FPG, %d con errores, %.2f ms, %d hilos\n", int(inputs.size()), failed,
+               wallClock.nsecsElapsed() / 1e6, QThreadPool::globalInstance()->maxThreadCount());
+        return failed == 0 ? 0 : 2;
+    }
+
+    // Consultas: indexar una vez y responder desde el índice en memoria
+    if (parser.isSet(textureOption) || parser.isSet(sizeOption) || parser.isSet(fpgOption)) {
+        MapLibrary library;
+        const int indexed = library.addFiles(inputs);
+        printf("%d de %d mapas indexados en %.2f ms\n", indexed, int(inputs.size()),
+               wallClock.nsecsElapsed() / 1e6);
+
+        auto printMatches = [](const QString &title, const QStringList &maps) {
+            printf("\n%s: %d mapas\n", qPrintable(title), int(maps.size()));
+            for (const QString &map : maps) printf("  %s\n", qPrintable(map));
+        };
+        if (parser.isSet(textureOption)) {
+            const int code = parser.value(textureOption).toInt();
+            printMatches(QString("Textura %1").arg(code), library.mapsUsingTexture(code));
+        }
+        if (parser.isSet(sizeOption)) {
+            const QStringList size = parser.value(sizeOption).split('x', Qt::SkipEmptyParts, Qt::CaseInsensitive);
+            if (size.size() != 2) {
+                fprintf(stderr, "Tamaño no válido: %s\n", qPrintable(parser.value(sizeOption)));
+                return 1;
+            }
+            printMatches("Mayores que " + parser.value(sizeOption),
+                         library.mapsLargerThan(size[0].toInt(), size[1].toInt()));
+        }
+        if (parser.isSet(fpgOption)) {
+            printMatches("FPG " + parser.value(fpgOption), library.mapsUsingFPG(parser.value(fpgOption)));
+        }
+        return indexed == inputs.size() ? 0 : 2;
+    }
+
+    std::function<ConvertResult(const QString &)> task =
+        [options](const QString &input) { return convertMap(input, options); };
+    const QList<ConvertResult> results = QtConcurrent::blockingMapped<QList<ConvertResult>>(inputs, task);
+
+    // Resumen
+    int failed = 0;
+    qint64 busyNs = 0;
+    for (const ConvertResult &result : results) {
+        if (!result.ok) failed++;
+        busyNs += result.elapsedNs;
+    }
+    const double wallMs = wallClock.nsecsElapsed() / 1e6;
+    printf("\n%d mapas, %d correctos, %d con errores\n", int(results.size()),
+           int(results.size()) - failed, failed);
+    printf("Tiempo total %.2f ms, suma por mapa %.2f ms, %d hilos\n", wallMs, busyNs / 1e6,
+           QThreadPool::globalInstance()->maxThreadCount());
+
+    return failed == 0 ? 0 : 2;
+}
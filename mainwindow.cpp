@@ -15,6 +15,19 @@
 #include <QFileInfo>
 #include <QPixmap>
 #include <zlib.h>
+#include "GzipUtils.h"
+#include "FPGTextureSource.h"
+#include "MapTasks.h"
+#include "MapTrace.h"
+#include <QFutureWatcher>
+#include <QMenu>
+#include <QMenuBar>
+#include <QProgressBar>
+#include <QStatusBar>
+#include <QThreadPool>
+#include <QTimer>
+#include <QToolButton>
+#include <QtConcurrent>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -66,6 +79,38 @@ MainWindow::MainWindow(QWidget *parent)
     // Añadir conexión para coordenadas del mouse
     connect(editorScene, &EditorScene::mouseMoved,
             this, &MainWindow::onMouseMoved);
+
+    // Progreso y cancelación de tareas en segundo plano en la barra de estado
+    taskProgress = new QProgressBar(this);
+    taskProgress->setRange(0, 100);
+    taskProgress->setMaximumWidth(250);
+    taskProgress->hide();
+    taskCancelButton = new QToolButton(this);
+    taskCancelButton->setText("Cancelar");
+    taskCancelButton->hide();
+    statusBar()->addPermanentWidget(taskProgress);
+    statusBar()->addPermanentWidget(taskCancelButton);
+
+    connect(taskCancelButton, &QToolButton::clicked, this, [this]() {
+        if (backgroundTask) backgroundTask->cancelled = true;
+    });
+
+    // Las texturas del mapa se pueden guardar como un FPG nuevo
+    QMenu *textureMenu = menuBar()->addMenu("Texturas");
+    textureMenu->addAction("Guardar texturas como .fpg...", this, &MainWindow::saveTexturesToFPG);
+
+    taskTimer = new QTimer(this);
+    taskTimer->setInterval(50);
+    connect(taskTimer, &QTimer::timeout, this, [this]() {
+        if (backgroundTask) taskProgress->setValue(backgroundTask->progress);
+
+        // Miniaturas por tandas: se muestran en cuanto hay alguna nueva
+        if (thumbnailTask && thumbnailTask->itemsReady != thumbnailsShown) {
+            thumbnailsShown = thumbnailTask->itemsReady;
+            updateTextureList();
+            updateTextureThumbnails();
+        }
+    });
 }
 
 void MainWindow::on_addSectorButton_clicked() {
@@ -98,20 +143,65 @@ void MainWindow::on_addWallButton_clicked() {
 }
 
 void MainWindow::on_addTextureButton_clicked() {
+    if (backgroundTask) {
+        QMessageBox::information(this, "Información", "Espera a que termine la operación en curso");
+        return;
+    }
+
     QString filename = QFileDialog::getOpenFileName(this,
                                                     "Seleccionar archivo .fpg", "", "FPG Files (*.fpg)");
 
     if (!filename.isEmpty()) {
-        if (loadFPGFile(filename)) {
-            updateTextureList();
-            forceSyncSectorList();
-            qDebug() << "Texturas FPG cargadas:" << currentMap.textures.size();
-        }
+        loadFPGFile(filename);
     }
 }
 
 
 
+void MainWindow::saveTexturesToFPG() {
+    if (backgroundTask) {
+        QMessageBox::information(this, "Información", "Espera a que termine la operación en curso");
+        return;
+    }
+    if (currentMap.textures.empty()) {
+        QMessageBox::information(this, "Información", "No hay texturas cargadas. Por favor, carga un archivo .fpg primero");
+        return;
+    }
+
+    const QString compressedFilter = "FPG comprimido gzip (*.fpg)";
+    QString selectedFilter;
+    QString filename = QFileDialog::getSaveFileName(this, "Guardar texturas como FPG", "",
+                                                    "FPG Files (*.fpg);;" + compressedFilter,
+                                                    &selectedFilter);
+    if (filename.isEmpty()) return;
+
+    // Los chunks se copian de los FPG de origen (compartidos, de solo
+    // lectura), así que el hilo de trabajo puede usar una copia de la lista
+    const QVector<TextureEntry> textures = currentMap.textures;
+    const bool compressed = selectedFilter == compressedFilter;
+    std::shared_ptr<TaskControl> control = beginBackgroundTask("Guardando FPG...");
+    QFutureWatcher<FPGSaveResult> *watcher = new QFutureWatcher<FPGSaveResult>(this);
+    connect(watcher, &QFutureWatcher<FPGSaveResult>::finished, this, [this, watcher, control]() {
+        watcher->deleteLater();
+        endBackgroundTask();
+
+        const FPGSaveResult result = watcher->result();
+        if (control->cancelled) {
+            statusBar()->showMessage("Guardado del FPG cancelado", 3000);
+        } else if (result.mixedSources) {
+            QMessageBox::critical(this, "Error",
+                                  "Las texturas vienen de archivos .fpg con distinta profundidad o paleta");
+        } else if (!result.ok) {
+            QMessageBox::critical(this, "Error", "No se pudo guardar el archivo .fpg");
+        } else {
+            statusBar()->showMessage(QString("FPG guardado: %1 texturas").arg(result.chunks), 3000);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run([textures, filename, compressed, control]() {
+        return saveFPGTask(textures, filename, compressed, control);
+    }));
+}
+
 void MainWindow::updateSectorList() {
     ui->sectorList->clear();
     for (int i = 0; i < currentMap.regions.size(); i++) {
@@ -124,6 +214,7 @@ void MainWindow::updateSectorList() {
 }
 
 void MainWindow::updateTextureList() {
+    MAP_TRACE_SPAN(lcScene, "MainWindow::updateTextureList");
     // Limpiar thumbnails existentes
     ui->wallTextureThumb->setIcon(QIcon());
     ui->ceilingTextureThumb->setIcon(QIcon());
@@ -138,9 +229,8 @@ void MainWindow::updateTextureList() {
     int thumbCount = qMin(3, (int)currentMap.textures.size());
 
     for (int i = 0; i < thumbCount; i++) {
-        if (!currentMap.textures[i].pixmap.isNull()) {
-            QPixmap thumbnail = currentMap.textures[i].pixmap.scaled(64, 64,
-                                                                     Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        if (!currentMap.textures[i].isNull()) {
+            QPixmap thumbnail = currentMap.textures[i].thumbnail(64);
 
             switch (i) {
             case 0:
@@ -156,213 +246,122 @@ void MainWindow::updateTextureList() {
         }
     }
 
-    ui->texFileLabel->setText(QString("Archivo .fpg: %1 texturas").arg(currentMap.textures.size()));
-}
-
-
-bool MainWindow::loadFPGFile(const QString &filename) {
-    QFile file(filename);
-    if (!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::critical(this, "Error", "No se pudo abrir el archivo .fpg");
-        return false;
+    QString label = QString("Archivo .fpg: %1 texturas").arg(currentMap.textures.size());
+    if (thumbnailTask) {
+        label += QString(" (miniaturas %1/%2)").arg(thumbnailTask->itemsReady).arg(currentMap.textures.size());
     }
+    ui->texFileLabel->setText(label);
+}
 
-    // Leer header principal (8 bytes)
-    QByteArray headerBytes = file.read(8);
-    qDebug() << "Header leído (hex):" << headerBytes.toHex();
-
-    QByteArray uncompressedData;
-
-    // Detectar gzip
-    if (headerBytes.startsWith(QByteArray::fromHex("1f8b"))) {
-        qDebug() << "Archivo FPG comprimido con gzip detectado";
-
-        // Volver al inicio y leer todo para descompresión
-        file.seek(0);
-        QByteArray compressedData = file.readAll();
-
-        // Descompresión robusta con buffer dinámico
-        z_stream strm;
-        strm.zalloc = Z_NULL;
-        strm.zfree = Z_NULL;
-        strm.opaque = Z_NULL;
-        strm.avail_in = compressedData.size();
-        strm.next_in = (Bytef*)compressedData.data();
-
-        // Inicializar inflate con modo gzip (+16)
-        int ret = inflateInit2(&strm, 15 + 16);
-        if (ret != Z_OK) {
-            qDebug() << "inflateInit2 failed:" << ret;
-            QMessageBox::critical(this, "Error", "Fallo al inicializar descompresión gzip");
-            return false;
-        }
-
-        // Buffer dinámico que crece según necesidad
-        QByteArray buffer;
-        buffer.resize(4096); // Tamaño inicial
-
-        do {
-            strm.avail_out = buffer.size();
-            strm.next_out = (Bytef*)buffer.data();
-
-            ret = inflate(&strm, Z_NO_FLUSH);
-
-            if (ret == Z_STREAM_ERROR) {
-                qDebug() << "inflate error:" << ret;
-                inflateEnd(&strm);
-                QMessageBox::critical(this, "Error", "Error durante descompresión gzip");
-                return false;
-            }
-
-            // Calcular bytes descomprimidos en esta iteración
-            size_t have = buffer.size() - strm.avail_out;
-            uncompressedData.append(buffer.data(), have);
-
-            // Si necesitamos más espacio, agrandar buffer
-            if (strm.avail_out == 0) {
-                buffer.resize(buffer.size() * 2);
-            }
-
-        } while (ret != Z_STREAM_END);
-
-        inflateEnd(&strm);
-        qDebug() << "Descompresión exitosa - Bytes descomprimidos:" << uncompressedData.size();
-
-    } else {
-        // Archivo sin comprimir
-        file.seek(0);
-        uncompressedData = file.readAll();
-        qDebug() << "Archivo FPG sin comprimir detectado";
-    }
 
-    file.close();
+void MainWindow::loadFPGFile(const QString &filename) {
+    // Descompresión e índice en un hilo de trabajo; el mapa sigue editable y
+    // las texturas anteriores se mantienen hasta que el FPG nuevo está listo
+    std::shared_ptr<TaskControl> control = beginBackgroundTask("Cargando FPG...");
+    QFutureWatcher<FPGLoadResult> *watcher = new QFutureWatcher<FPGLoadResult>(this);
+    connect(watcher, &QFutureWatcher<FPGLoadResult>::finished, this,
+            [this, watcher, filename]() {
+        watcher->deleteLater();
+        endBackgroundTask();
+        onFPGLoaded(filename, watcher->result());
+    });
+    watcher->setFuture(QtConcurrent::run([filename, control]() {
+        return loadFPGTask(filename, control);
+    }));
+}
 
-    // Validar magic number del formato FPG (case-insensitive)
-    if (uncompressedData.size() < 8) {
-        QMessageBox::critical(this, "Error", "Archivo FPG demasiado pequeño");
-        return false;
+void MainWindow::onFPGLoaded(const QString &filename, const FPGLoadResult &result) {
+    if (result.cancelled) {
+        statusBar()->showMessage("Carga del FPG cancelada", 3000);
+        return;
     }
-
-    QString magicOriginal = QString::fromLatin1(uncompressedData.left(7));
-    QString magicBase = magicOriginal.left(3).toUpper();
-
-    if (magicBase != "F32") {
+    if (!result.ok) {
         QMessageBox::critical(this, "Error",
-                              QString("Formato .fpg inválido - se esperaba 'F32*', se encontró '%1'")
-                                  .arg(magicOriginal));
-        return false;
+                              QString("No se pudo cargar el archivo .fpg\n%1").arg(result.error.toString()));
+        return;
     }
 
-    qDebug() << "Magic number original:" << magicOriginal;
-    qDebug() << "Magic number validado correctamente";
-
-    // Configurar QDataStream con endianness correcto
-    QDataStream in(uncompressedData);
-    in.setByteOrder(QDataStream::LittleEndian);  // ¡CRUCIAL! BennuGD2 usa little-endian
-    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
-
-    // Saltar header (8 bytes)
-    in.skipRawData(8);
-
-    // Procesar chunks del archivo FPG
-    int chunkCount = 0;
-    currentMap.textures.clear();
-
-    qDebug() << "Iniciando lectura de chunks...";
-
-    while (!in.atEnd()) {
-        // Leer estructura FPG_info usando operadores >> que respetan endianness
-        FPG_CHUNK chunk;
-        in >> chunk.code >> chunk.regsize;
-        in.readRawData(chunk.name, 32);
-        in.readRawData(chunk.filename, 12);
-        in >> chunk.width >> chunk.height >> chunk.flags;
-
-        if (in.status() != QDataStream::Ok) {
-            qDebug() << "Error leyendo chunk header";
-            break;
-        }
-
-        qDebug() << QString("Chunk %1 : código=%2, tamaño=%3x%4, flags=%5")
-                        .arg(chunkCount + 1)
-                        .arg(chunk.code)
-                        .arg(chunk.width)
-                        .arg(chunk.height)
-                        .arg(chunk.flags);
-
-        // Validar dimensiones del chunk
-        if (chunk.width <= 0 || chunk.height <= 0 ||
-            chunk.width > 4096 || chunk.height > 4096) {
-            qDebug() << "Chunk con dimensiones inválidas, saltando";
-            continue;
-        }
-
-        // Leer control points si flags > 0
-        if (chunk.flags > 0) {
-            int numPoints = chunk.flags;
-            for (int i = 0; i < numPoints; i++) {
-                int16_t x, y;
-                in >> x >> y;
-            }
-        }
+    // Sólo se recorrieron las cabeceras: cada textura se decodifica la primera
+    // vez que se dibuja y la caché del FPG limita cuántas siguen en memoria
+    std::shared_ptr<FPGTextureSource> source = result.source;
+    qCDebug(lcLoad) << "Chunks encontrados:" << source->chunks().size();
 
-        // Calcular tamaño de datos de píxeles según formato
-        int pixelDataSize = chunk.width * chunk.height * 4; // 32 bits RGBA
+    // Las miniaturas del FPG anterior ya no se van a mostrar
+    if (thumbnailTask) thumbnailTask->cancelled = true;
 
-        // Leer datos de píxeles
-        char* pixelBuffer = new char[pixelDataSize];
-        int bytesRead = in.readRawData(pixelBuffer, pixelDataSize);
+    QVector<TextureEntry> textures;
+    textures.reserve(source->chunks().size());
 
-        if (bytesRead != pixelDataSize) {
-            qDebug() << "Error: no se pudieron leer todos los bytes del chunk";
-            delete[] pixelBuffer;
-            break;
-        }
+    for (int i = 0; i < source->chunks().size(); i++) {
+        const FPGChunkInfo &chunk = source->chunks()[i];
+        TextureEntry tex(filename, chunk.code);
+        tex.width = chunk.width;
+        tex.height = chunk.height;
+        tex.source = source;
+        tex.chunk = i;
+        textures.append(tex);
+    }
+    currentMap.setTextures(textures);
 
-        // Convertir de BGRA a RGBA manualmente para corregir colores
-        for (int i = 0; i < pixelDataSize; i += 4) {
-            char temp = pixelBuffer[i];
-            pixelBuffer[i] = pixelBuffer[i + 2];   // R = B
-            pixelBuffer[i + 2] = temp;             // B = R
-            // G y A permanecen igual
-        }
+    qCDebug(lcLoad) << "Texturas FPG cargadas:" << currentMap.textures.size();
 
-        // Crear QImage desde el buffer corregido
-        QImage image(reinterpret_cast<const uchar*>(pixelBuffer),
-                     chunk.width, chunk.height, QImage::Format_RGBA8888);
-
-        if (!image.isNull()) {
-            // Crear QPixmap y añadir a currentMap.textures
-            QPixmap pixmap = QPixmap::fromImage(image);
-            TextureEntry tex(filename, chunk.code);
-            tex.pixmap = pixmap;
-            currentMap.textures.append(tex);
-            qDebug() << "Textura" << chunk.code << "cargada exitosamente";
-        } else {
-            qWarning() << "Error al crear QImage para chunk" << chunk.code;
-        }
+    updateTextureList();
+    updateTextureThumbnails();
+    forceSyncSectorList();
 
-        delete[] pixelBuffer;
-        chunkCount++;
+    // Sin avisos basta con la barra de estado; el editor no se interrumpe
+    statusBar()->showMessage(QString("Se cargaron %1 texturas desde el archivo FPG")
+                                 .arg(currentMap.textures.size()), 5000);
 
-        // Límite de seguridad para evitar bucles infinitos
-        if (chunkCount > 1000) {
-            qDebug() << "Alcanzado límite máximo de chunks";
-            break;
+    if (!source->issues().isEmpty()) {
+        QStringList details;
+        for (const FPGChunkIssue &issue : source->issues()) {
+            qCWarning(lcLoad) << "FPG" << filename << issue.toString();
+            if (details.size() < 20) details << issue.toString();
         }
+        QMessageBox::warning(this, "FPG cargado con avisos",
+                             QString("Se cargaron %1 texturas; %2 avisos:\n%3")
+                                 .arg(currentMap.textures.size())
+                                 .arg(source->issues().size())
+                                 .arg(details.join("\n")));
     }
 
-    qDebug() << "Procesados" << chunkCount << "chunks";
-    qDebug() << "Texturas FPG cargadas:" << currentMap.textures.size();
+    buildThumbnailsInBackground(source);
+}
 
+void MainWindow::buildThumbnailsInBackground(std::shared_ptr<FPGTextureSource> source) {
+    // Duplicados y miniaturas de todo el paquete en su propia tarea, fuera de
+    // backgroundTask: guardar o cargar un mapa no tiene que esperar. Mientras
+    // tanto las miniaturas que se pidan se construyen al momento; si se
+    // cancela, el resto se hará bajo demanda.
+    std::shared_ptr<TaskControl> control = std::make_shared<TaskControl>();
+    thumbnailTask = control;
+    thumbnailsShown = 0;
+    taskTimer->start();
     updateTextureList();
-    updateTextureThumbnails();
 
-    QMessageBox::information(this, "Éxito",
-                             QString("Se cargaron %1 texturas desde el archivo FPG")
-                                 .arg(currentMap.textures.size()));
+    QFutureWatcher<void> *watcher = new QFutureWatcher<void>(this);
+    connect(watcher, &QFutureWatcher<void>::finished, this, [this, watcher, source, control]() {
+        watcher->deleteLater();
 
-    return true;
+        // Si entretanto se cargó otro FPG, su tarea ya sustituyó a esta
+        if (thumbnailTask != control) return;
+        thumbnailTask.reset();
+        if (!backgroundTask) taskTimer->stop();
+        updateTextureList();
+        updateTextureThumbnails();
+
+        const FPGTextureSource::DedupStats dedup = source->dedupStats();
+        if (dedup.duplicates > 0) {
+            qCDebug(lcLoad) << "Texturas duplicadas:" << dedup.duplicates
+                     << "- memoria compartida:" << dedup.bytesSaved / 1024 << "KiB";
+            statusBar()->showMessage(QString("%1 texturas idénticas comparten imagen, %2 KiB ahorrados")
+                                         .arg(dedup.duplicates).arg(dedup.bytesSaved / 1024), 5000);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run([source, control]() {
+        buildThumbnailsTask(source, control);
+    }));
 }
 
 void MainWindow::onVertexAdded(QPointF pos) {
@@ -401,6 +400,9 @@ void MainWindow::onPolygonFinished() {
     region.ceil_tex = 0;
     region.fade = 0;
 
+    const int firstNewPoint = currentMap.points.size();
+    const int firstNewWall = currentMap.walls.size();
+
     // Convertir coordenadas de pantalla (0-800) a coordenadas de mapa divmap3d (0-30208)
     std::vector<int> pointIndices;
     for (const QPointF &vertex : currentPolygon) {
@@ -445,6 +447,16 @@ void MainWindow::onPolygonFinished() {
 
     currentMap.regions.push_back(region);
 
+    // Registrar en el diario los puntos nuevos, las paredes y la región
+    for (int i = firstNewPoint; i < (int)currentMap.points.size(); i++) {
+        journal.recordPoint(i, currentMap.points[i]);
+    }
+    for (int i = firstNewWall; i < (int)currentMap.walls.size(); i++) {
+        journal.recordWall(i, currentMap.walls[i]);
+    }
+    journal.recordRegion(sectorIndex, region);
+    mapEdited();
+
     // Limpiar elementos temporales
     QList<QGraphicsItem*> items = scene->items();
     for (QGraphicsItem* item : items) {
@@ -551,6 +563,8 @@ void MainWindow::on_floorHeightSpin_valueChanged(double value) {
     int index = ui->sectorList->currentRow();
     if (index >= 0 && index < currentMap.regions.size()) {
         currentMap.regions[index].floor_height = value;
+        journal.recordRegion(index, currentMap.regions[index]);
+        mapEdited();
         updateSectorList();
     }
 }
@@ -559,41 +573,203 @@ void MainWindow::on_ceilingHeightSpin_valueChanged(double value) {
     int index = ui->sectorList->currentRow();
     if (index >= 0 && index < currentMap.regions.size()) {
         currentMap.regions[index].ceiling_height = value;
+        journal.recordRegion(index, currentMap.regions[index]);
+        mapEdited();
         updateSectorList();
     }
 }
 
 void MainWindow::on_exportWLDButton_clicked() {
+    if (backgroundTask) {
+        QMessageBox::information(this, "Información", "Espera a que termine la operación en curso");
+        return;
+    }
+
+    const QString compressedFilter = "WLD comprimido gzip (*.wld)";
+    const QString datFilter = "DAT del motor (*.dat)";
+    QString selectedFilter;
     QString filename = QFileDialog::getSaveFileName(this,
-                                                    "Guardar Mapa WLD", "", "WLD Files (*.wld)");
+                                                    "Guardar Mapa WLD", "",
+                                                    "WLD Files (*.wld);;" + compressedFilter + ";;" + datFilter,
+                                                    &selectedFilter);
+    if (filename.isEmpty()) return;
 
-    if (!filename.isEmpty()) {
-        if (currentMap.saveToWLD(filename)) {
-            QMessageBox::information(this, "Éxito", "Mapa guardado en formato WLD");
+    if (selectedFilter == datFilter) {
+        // Como map_save: regiones y portales se asignan antes de escribir el DAT
+        ModernMap datMap = currentMap;
+        datMap.assignRegionsAndPortals();
+
+        QStringList overflows;
+        if (datMap.saveToDAT(filename, &overflows)) {
+            QMessageBox::information(this, "Éxito", "Mapa exportado en formato DAT");
+        } else if (!overflows.isEmpty()) {
+            QMessageBox::critical(this, "Error",
+                                  QString("%1 valores no caben en 16 bits:\n%2")
+                                      .arg(overflows.size())
+                                      .arg(overflows.mid(0, 20).join("\n")));
         } else {
-            QMessageBox::critical(this, "Error", "No se pudo guardar el archivo WLD");
+            QMessageBox::critical(this, "Error", "No se pudo guardar el archivo DAT");
         }
+        return;
     }
+
+    saveInBackground(filename, selectedFilter == compressedFilter, true);
+}
+
+void MainWindow::saveInBackground(const QString &filename, bool compressed, bool announce) {
+    // El hilo de trabajo guarda una copia inmutable; se puede seguir editando
+    std::shared_ptr<const ModernMap> snapshot = std::make_shared<ModernMap>(currentMap);
+    const quint64 generationAtSnapshot = editGeneration;
+    const quint64 session = mapSession;
+
+    std::shared_ptr<TaskControl> control = beginBackgroundTask("Guardando mapa...");
+    QFutureWatcher<MapSaveResult> *watcher = new QFutureWatcher<MapSaveResult>(this);
+    connect(watcher, &QFutureWatcher<MapSaveResult>::finished, this,
+            [this, watcher, control, snapshot, filename, compressed, announce, generationAtSnapshot, session]() {
+        watcher->deleteLater();
+        endBackgroundTask();
+
+        const MapSaveResult result = watcher->result();
+        if (control->cancelled) {
+            statusBar()->showMessage("Guardado cancelado", 3000);
+            return;
+        }
+        if (!result.ok) {
+            QMessageBox::critical(this, "Error", "No se pudo guardar el archivo WLD");
+            return;
+        }
+
+        // El .wldx describe la copia que se guardó, con la clave de esos bytes
+        refreshSidecar(filename, snapshot, result.key);
+
+        // Si entretanto se empezó otro mapa, el fichero ya no es el suyo
+        if (mapSession != session) return;
+
+        // Mientras se guardaba, las ediciones siguieron yendo al diario
+        // anterior. Las que no están en el fichero nuevo pasan al diario
+        // nuevo y se guardan en otra pasada en segundo plano.
+        if (editGeneration == generationAtSnapshot) {
+            startJournal(filename, compressed);
+        } else {
+            startJournal(filename, compressed, snapshot.get());
+            if (!backgroundTask) saveInBackground(filename, compressed, false);
+        }
+
+        if (announce) QMessageBox::information(this, "Éxito", "Mapa guardado en formato WLD");
+        else statusBar()->showMessage("Mapa guardado", 3000);
+    });
+    watcher->setFuture(QtConcurrent::run([snapshot, filename, compressed, control]() {
+        return saveMapTask(snapshot, filename, compressed, control);
+    }));
 }
 
 void MainWindow::on_importWLDButton_clicked() {
+    if (backgroundTask) {
+        QMessageBox::information(this, "Información", "Espera a que termine la operación en curso");
+        return;
+    }
+
     QString filename = QFileDialog::getOpenFileName(this,
                                                     "Cargar Mapa WLD", "", "WLD Files (*.wld)");
     if (filename.isEmpty()) return;
 
-    if (currentMap.loadFromWLD(filename)) {
-        drawWLDMap(true);  // Ajustar vista al cargar nuevo mapa
-        updateSectorList();
+    // Lectura y geometría en un hilo de trabajo; el mapa actual sigue editable
+    // hasta que el resultado se intercambia en finished
+    std::shared_ptr<TaskControl> control = beginBackgroundTask("Cargando mapa...");
+    QFutureWatcher<MapLoadResult> *watcher = new QFutureWatcher<MapLoadResult>(this);
+    connect(watcher, &QFutureWatcher<MapLoadResult>::finished, this,
+            [this, watcher, filename]() {
+        watcher->deleteLater();
+        endBackgroundTask();
+        onMapLoaded(filename, watcher->result());
+    });
+    watcher->setFuture(QtConcurrent::run([filename, control]() {
+        return loadMapTask(filename, control);
+    }));
+}
 
-        QMessageBox::information(this, "Éxito",
-                                 QString("Mapa WLD cargado: %1 regiones, %2 paredes")
-                                     .arg(currentMap.regions.size())
-                                     .arg(currentMap.walls.size()));
+void MainWindow::onMapLoaded(const QString &filename, const MapLoadResult &result) {
+    if (result.cancelled) {
+        statusBar()->showMessage("Carga cancelada", 3000);
+        return;
+    }
+    if (!result.ok) {
+        QMessageBox::critical(this, "Error",
+                              QString("No se pudo cargar el archivo WLD\n%1").arg(result.error.toString()));
+        return;
     }
+
+    // Intercambio del mapa completo; las texturas cargadas se conservan.
+    // Un .wldx caducado se regenera a partir del mapa tal y como se leyó,
+    // así que en ese caso el hilo del sidecar se queda con el original.
+    QVector<TextureEntry> textures = currentMap.textures;
+    mapSession++;
+    if (result.sidecarStale) {
+        refreshSidecar(filename, result.map, result.key);
+        currentMap = *result.map;
+    } else {
+        currentMap = std::move(*result.map);
+    }
+    currentMap.setTextures(textures);
+    selectedSectorIndex = -1;
+
+    QFile wldFile(filename);
+    QByteArray magic = wldFile.open(QIODevice::ReadOnly) ? wldFile.read(2) : QByteArray();
+    bool compressed = isGzipData(magic.constData(), magic.size());
+
+    // Recuperar ediciones de una sesión que terminó sin guardar
+    ModernMap recovered = currentMap;
+    int pending = MapJournal::replay(filename, recovered);
+    bool recoveredEdits = pending > 0 &&
+        QMessageBox::question(this, "Recuperar cambios",
+                              QString("Hay %1 ediciones sin guardar de una sesión anterior.\n"
+                                      "¿Recuperarlas?").arg(pending),
+                              QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes;
+    if (recoveredEdits) {
+        // El diario nuevo empieza con las ediciones recuperadas, así que lo
+        // que se edite durante el guardado también queda registrado
+        ModernMap loaded = std::move(currentMap);
+        currentMap = std::move(recovered);
+        startJournal(filename, compressed, &loaded);
+        saveInBackground(filename, compressed, false);
+    } else {
+        startJournal(filename, compressed);
+    }
+
+    // La geometría del hilo de trabajo no incluye las ediciones recuperadas
+    drawWLDMap(true, recoveredEdits ? nullptr : &result.geometry);  // Ajustar vista al cargar nuevo mapa
+    updateSectorList();
+
+    QMessageBox::information(this, "Éxito",
+                             QString("Mapa WLD cargado: %1 regiones, %2 paredes")
+                                 .arg(currentMap.regions.size())
+                                 .arg(currentMap.walls.size()));
+}
+
+std::shared_ptr<TaskControl> MainWindow::beginBackgroundTask(const QString &label) {
+    backgroundTask = std::make_shared<TaskControl>();
+
+    taskProgress->setFormat(label + " %p%");
+    taskProgress->setValue(0);
+    taskProgress->show();
+    taskCancelButton->show();
+    taskTimer->start();
+
+    return backgroundTask;
+}
+
+void MainWindow::endBackgroundTask() {
+    if (!thumbnailTask) taskTimer->stop();
+    taskProgress->hide();
+    taskCancelButton->hide();
+    backgroundTask.reset();
 }
 
 void MainWindow::on_newMapButton_clicked() {
     currentMap.clear();
+    mapSession++;
+    journal.close();
+    currentMapPath.clear();
     scene->clear();
 
     // Redibujar grid
@@ -607,6 +783,7 @@ void MainWindow::on_newMapButton_clicked() {
 }
 
 void MainWindow::updateScene() {
+    MAP_TRACE_SPAN(lcScene, "MainWindow::updateScene");
     scene->clear();
 
     // Redibujar grid
@@ -657,7 +834,7 @@ int MainWindow::findOrCreatePoint(int32_t x, int32_t y) {
 
 void MainWindow::on_sectorList_currentRowChanged(int index) {
     if (index >= 0 && index >= currentMap.regions.size()) {
-        qDebug() << "Error: Inconsistencia entre UI y datos";
+        qCWarning(lcScene) << "Inconsistencia entre UI y datos";
         selectedSectorIndex = -1;
         return;
     }
@@ -792,7 +969,11 @@ void MainWindow::on_deleteSectorButton_clicked() {
         );
 
     if (reply == QMessageBox::Yes) {
-        currentMap.regions.erase(currentMap.regions.begin() + index);
+        // El diario sólo guarda la eliminación: replay renumera las paredes
+        // igual que eraseRegion
+        currentMap.eraseRegion(index);
+        journal.recordRegionErased(index);
+        mapEdited();
 
         // Redibujar escena
         scene->clear();
@@ -819,6 +1000,7 @@ void MainWindow::onSectorMoved(int sectorIndex, QPointF delta) {
             point.x += delta.x();
             point.y += delta.y();
         }
+        mapEdited();
 
         // Actualizar la lista visual
         updateSectorList();
@@ -831,6 +1013,8 @@ void MainWindow::onVertexMoved(int sectorIndex, int vertexIndex, QPointF newPosi
         if (vertexIndex >= 0 && vertexIndex < currentMap.points.size()) {
             currentMap.points[vertexIndex].x = static_cast<int32_t>(newPosition.x() * 30);
             currentMap.points[vertexIndex].y = static_cast<int32_t>(newPosition.y() * 30);
+            journal.recordPoint(vertexIndex, currentMap.points[vertexIndex]);
+            mapEdited();
         }
 
         // LIMPIAR ESCENA COMPLETAMENTE
@@ -1017,11 +1201,18 @@ void MainWindow::onWallFinished() {
         if (ix2 < 0) ix2 = 0; if (iy2 < 0) iy2 = 0;
         if (ix2 > FIN_GRID) ix2 = FIN_GRID; if (iy2 > FIN_GRID) iy2 = FIN_GRID;
 
+        const int firstNewPoint = currentMap.points.size();
         wall.p1 = findOrCreatePoint(ix1, iy1);
         wall.p2 = findOrCreatePoint(ix2, iy2);
 
         currentMap.walls.push_back(wall);
 
+        for (int i = firstNewPoint; i < (int)currentMap.points.size(); i++) {
+            journal.recordPoint(i, currentMap.points[i]);
+        }
+        journal.recordWall(currentMap.walls.size() - 1, wall);
+        mapEdited();
+
         // Eliminar elementos temporales
         QList<QGraphicsItem*> items = scene->items();
         for (QGraphicsItem* item : items) {
@@ -1063,12 +1254,13 @@ void MainWindow::on_wallTextureThumb_clicked() {
     }
 
     TextureSelectorDialog dialog(this);
-    dialog.setTextures(currentMap.textures);
+    dialog.setTextures(currentMap.textures, thumbnailTask);
 
     if (dialog.exec() == QDialog::Accepted) {
         int textureId = dialog.selectedTextureId();
-        if (textureId >= 0 && textureId < currentMap.textures.size()) {
+        if (currentMap.findTexture(textureId)) {
             currentMap.regions[selectedSectorIndex].wall_tex = textureId;
+            mapEdited();
             updateTextureThumbnails();
             updateSectorList();
         }
@@ -1083,12 +1275,14 @@ void MainWindow::on_ceilingTextureThumb_clicked() {
     }
 
     TextureSelectorDialog dialog(this);
-    dialog.setTextures(currentMap.textures);
+    dialog.setTextures(currentMap.textures, thumbnailTask);
 
     if (dialog.exec() == QDialog::Accepted) {
         int textureId = dialog.selectedTextureId();
-        if (textureId >= 0 && textureId < currentMap.textures.size()) {
+        if (currentMap.findTexture(textureId)) {
             currentMap.regions[selectedSectorIndex].ceil_tex = textureId;
+            journal.recordRegion(selectedSectorIndex, currentMap.regions[selectedSectorIndex]);
+            mapEdited();
             updateTextureThumbnails();
             updateSectorList();
         }
@@ -1103,12 +1297,14 @@ void MainWindow::on_floorTextureThumb_clicked() {
     }
 
     TextureSelectorDialog dialog(this);
-    dialog.setTextures(currentMap.textures);
+    dialog.setTextures(currentMap.textures, thumbnailTask);
 
     if (dialog.exec() == QDialog::Accepted) {
         int textureId = dialog.selectedTextureId();
-        if (textureId >= 0 && textureId < currentMap.textures.size()) {
+        if (currentMap.findTexture(textureId)) {
             currentMap.regions[selectedSectorIndex].floor_tex = textureId;
+            journal.recordRegion(selectedSectorIndex, currentMap.regions[selectedSectorIndex]);
+            mapEdited();
             updateTextureThumbnails();
             updateSectorList();
         }
@@ -1116,7 +1312,8 @@ void MainWindow::on_floorTextureThumb_clicked() {
 }
 
 void MainWindow::forceSyncSectorList() {
-    qDebug() << "Sincronización forzada - regions.size():" << currentMap.regions.size();
+    MAP_TRACE_SPAN(lcScene, "MainWindow::forceSyncSectorList");
+    qCDebug(lcScene) << "Sincronización forzada - regions.size():" << currentMap.regions.size();
 
     // Limpiar completamente la UI
     ui->sectorList->clear();
@@ -1131,7 +1328,7 @@ void MainWindow::forceSyncSectorList() {
                                     .arg(region.ceiling_height));
     }
 
-    qDebug() << "UI reconstruida con" << ui->sectorList->count() << "elementos";
+    qCDebug(lcScene) << "UI reconstruida con" << ui->sectorList->count() << "elementos";
 }
 
 
@@ -1142,42 +1339,41 @@ void MainWindow::updateTextureThumbnails() {
 
     const ModernRegion &region = currentMap.regions[selectedSectorIndex];
 
-    // Función auxiliar para encontrar textura por ID
-    auto findTextureById = [&](uint32_t id) -> const TextureEntry* {
-        for (const TextureEntry &tex : currentMap.textures) {
-            if (tex.id == id) {
-                return &tex;
-            }
-        }
-        return nullptr;
-    };
-
     // Actualizar thumbnail de pared
-    const TextureEntry *wallTex = findTextureById(region.wall_tex);     // wall_tex
-    if (wallTex && !wallTex->pixmap.isNull()) {
-        QPixmap thumb = wallTex->pixmap.scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    const TextureEntry *wallTex = currentMap.findTexture(region.wall_tex);     // wall_tex
+    if (wallTex && !wallTex->isNull()) {
+        QPixmap thumb = wallTex->thumbnail(64);
         ui->wallTextureThumb->setIcon(QIcon(thumb));
     }
 
     // Actualizar thumbnail de techo
-    const TextureEntry *ceilingTex = findTextureById(region.ceil_tex); // ceil_tex
-    if (ceilingTex && !ceilingTex->pixmap.isNull()) {
-        QPixmap thumb = ceilingTex->pixmap.scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    const TextureEntry *ceilingTex = currentMap.findTexture(region.ceil_tex); // ceil_tex
+    if (ceilingTex && !ceilingTex->isNull()) {
+        QPixmap thumb = ceilingTex->thumbnail(64);
         ui->ceilingTextureThumb->setIcon(QIcon(thumb));
     }
 
     // Actualizar thumbnail de suelo
-    const TextureEntry *floorTex = findTextureById(region.floor_tex);  // floor_tex
-    if (floorTex && !floorTex->pixmap.isNull()) {
-        QPixmap thumb = floorTex->pixmap.scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    const TextureEntry *floorTex = currentMap.findTexture(region.floor_tex);  // floor_tex
+    if (floorTex && !floorTex->isNull()) {
+        QPixmap thumb = floorTex->thumbnail(64);
         ui->floorTextureThumb->setIcon(QIcon(thumb));
     }
 }
 
-void MainWindow::drawWLDMap(bool adjustView) {
+void MainWindow::drawWLDMap(bool adjustView, const MapGeometry *precomputed) {
+    MAP_TRACE_SPAN(lcScene, "MainWindow::drawWLDMap");
     scene->clear();
 
-    if (currentMap.walls.empty()) {
+    // La geometría puede venir ya calculada desde un hilo de trabajo
+    MapGeometry computed;
+    if (!precomputed) {
+        computed = MapGeometry::build(currentMap);
+        precomputed = &computed;
+    }
+    const MapGeometry &geometry = *precomputed;
+
+    if (currentMap.walls.empty() || !geometry.valid) {
         zoom_level = 0.0625;
         scroll_x = 15104;
         scroll_y = 15104;
@@ -1189,32 +1385,14 @@ void MainWindow::drawWLDMap(bool adjustView) {
         return;
     }
 
-    // Calcular bounds del mapa
-    qreal minX = std::numeric_limits<qreal>::max();
-    qreal minY = std::numeric_limits<qreal>::max();
-    qreal maxX = std::numeric_limits<qreal>::min();
-    qreal maxY = std::numeric_limits<qreal>::min();
-
-    for (const ModernWall &wall : currentMap.walls) {
-        if (wall.p1 < currentMap.points.size() && wall.p2 < currentMap.points.size()) {
-            const ModernPoint &p1 = currentMap.points[wall.p1];
-            const ModernPoint &p2 = currentMap.points[wall.p2];
-
-            minX = std::min({minX, (qreal)p1.x, (qreal)p2.x});
-            minY = std::min({minY, (qreal)p1.y, (qreal)p2.y});
-            maxX = std::max({maxX, (qreal)p1.x, (qreal)p2.x});
-            maxY = std::max({maxY, (qreal)p1.y, (qreal)p2.y});
-        }
-    }
-
     // Calcular escala para ajustar mapa a pantalla
-    qreal mapWidth = maxX - minX;
-    qreal mapHeight = maxY - minY;
+    qreal mapWidth = geometry.maxX - geometry.minX;
+    qreal mapHeight = geometry.maxY - geometry.minY;
     scale = 800.0 / std::max(mapWidth, mapHeight);
 
     // Calcular centro del mapa para centrarlo en pantalla
-    qreal mapCenterX = (minX + maxX) / 2.0;
-    qreal mapCenterY = (minY + maxY) / 2.0;
+    qreal mapCenterX = (geometry.minX + geometry.maxX) / 2.0;
+    qreal mapCenterY = (geometry.minY + geometry.maxY) / 2.0;
 
     qreal centerX = 400;
     qreal centerY = 400;
@@ -1261,28 +1439,14 @@ void MainWindow::drawWLDMap(bool adjustView) {
     }
 
     // Dibujar polígonos de sectores
-    for (size_t sectorIdx = 0; sectorIdx < currentMap.regions.size(); sectorIdx++) {
-        std::vector<QPointF> sectorPoints;
-
-        for (const ModernWall &wall : currentMap.walls) {
-            if (wall.front_region == sectorIdx) {
-                if (wall.p1 < currentMap.points.size()) {
-                    qreal x1 = (currentMap.points[wall.p1].x * scale) + offsetX;
-                    qreal y1 = (currentMap.points[wall.p1].y * scale) + offsetY;
-                    sectorPoints.push_back(QPointF(x1, y1));
-                }
-                if (wall.p2 < currentMap.points.size()) {
-                    qreal x2 = (currentMap.points[wall.p2].x * scale) + offsetX;
-                    qreal y2 = (currentMap.points[wall.p2].y * scale) + offsetY;
-                    sectorPoints.push_back(QPointF(x2, y2));
-                }
-            }
-        }
+    for (size_t sectorIdx = 0; sectorIdx < geometry.regionPoints.size(); sectorIdx++) {
+        const std::vector<QPointF> &sectorPoints = geometry.regionPoints[sectorIdx];
 
         if (sectorPoints.size() >= 3) {
             QPolygonF polygon;
+            polygon.reserve(sectorPoints.size());
             for (const QPointF &point : sectorPoints) {
-                polygon << point;
+                polygon << QPointF((point.x() * scale) + offsetX, (point.y() * scale) + offsetY);
             }
 
             bool isSelected = (sectorIdx == selectedSectorIndex);
@@ -1317,137 +1481,44 @@ void MainWindow::onSectorClicked(int sectorIndex) {
     }
 }
 
-void MainWindow::assignRegionsAndPortals() {
-    // Ordenar regiones por profundidad primero
-    sortRegionsByDepth();
-
-    // Analizar cada pared para determinar portales
-    for (int i = 0; i < currentMap.walls.size(); i++) {
-        ModernWall &wall = currentMap.walls[i];
-
-        // Inicializar como pared normal
-        wall.back_region = -1;
-        wall.type = 2; // Pared normal
-
-        // Buscar paredes compartidas (portales potenciales)
-        for (int j = i + 1; j < currentMap.walls.size(); j++) {
-            if (wallsShareVertices(wall, currentMap.walls[j])) {
-                if (wallsHaveOppositeOrientation(wall, currentMap.walls[j])) {
-                    // Es un portal - asignar back_region
-                    wall.back_region = currentMap.walls[j].front_region;
-                    wall.type = 1; // Portal
-
-                    // Configurar texturas para portal
-                    wall.texture_top = wall.texture;
-                    wall.texture_bot = wall.texture;
-                    wall.texture = 0; // Sin textura media en portales
-                }
-            }
-        }
+void MainWindow::startJournal(const QString &filename, bool compressed, const ModernMap *base) {
+    currentMapPath = filename;
+    currentMapCompressed = compressed;
+    const bool started = base ? journal.start(filename, *base, currentMap) : journal.start(filename);
+    if (!started) {
+        qWarning() << "No se pudo crear el diario de ediciones para" << filename;
     }
 }
 
-bool MainWindow::wallsShareVertices(const ModernWall &w1, const ModernWall &w2) {
-    return (w1.p1 == w2.p1 && w1.p2 == w2.p2) ||
-           (w1.p1 == w2.p2 && w1.p2 == w2.p1);
+void MainWindow::mapEdited() {
+    editGeneration++;
+    compactJournalIfNeeded();
 }
 
-bool MainWindow::wallsHaveOppositeOrientation(const ModernWall &w1, const ModernWall &w2) {
-    return w1.front_region != w2.front_region;
-}
-
-void MainWindow::sortRegionsByDepth() {
-    if (currentMap.regions.size() <= 1) {
-        return;
-    }
-
-    // Inicializar todas las regiones con type = 1 (nivel más externo)
-    for (int i = 0; i < currentMap.regions.size(); i++) {
-        currentMap.regions[i].type = 1;
-    }
-
-    // Calcular el número máximo de vértices por región
-    int maxVertex = 0;
-    std::vector<int> regionVertexCount(currentMap.regions.size(), 0);
-
-    for (const ModernWall &wall : currentMap.walls) {
-        if (wall.front_region >= 0 && wall.front_region < currentMap.regions.size()) {
-            regionVertexCount[wall.front_region]++;
-        }
-    }
-
-    for (int count : regionVertexCount) {
-        if (count + 1 > maxVertex) {
-            maxVertex = count + 1;
-        }
-    }
-
-    // Crear polígonos para cada región
-    std::vector<std::vector<QPointF>> regionPolygons(currentMap.regions.size());
-
-    for (int regionIdx = 0; regionIdx < currentMap.regions.size(); regionIdx++) {
-        std::vector<QPointF> vertices;
-
-        for (const ModernWall &wall : currentMap.walls) {
-            if (wall.front_region == regionIdx) {
-                if (wall.p1 < currentMap.points.size()) {
-                    vertices.push_back(QPointF(currentMap.points[wall.p1].x,
-                                               currentMap.points[wall.p1].y));
-                }
-            }
-        }
-
-        regionPolygons[regionIdx] = vertices;
-    }
-
-    // Determinar profundidad de cada región
-    for (int wallIdx = 0; wallIdx < currentMap.walls.size(); wallIdx++) {
-        const ModernWall &wall = currentMap.walls[wallIdx];
-
-        // Calcular punto medio de la pared
-        if (wall.p1 < currentMap.points.size() && wall.p2 < currentMap.points.size()) {
-            qreal midX = (currentMap.points[wall.p1].x + currentMap.points[wall.p2].x) / 2.0;
-            qreal midY = (currentMap.points[wall.p1].y + currentMap.points[wall.p2].y) / 2.0;
-
-            // Determinar en qué regiones está este punto medio
-            int maxDepth = 1;
-            for (int regionIdx = 0; regionIdx < currentMap.regions.size(); regionIdx++) {
-                if (regionIdx != wall.front_region && isPointInRegion(midX, midY, regionPolygons[regionIdx])) {
-                    if (currentMap.regions[regionIdx].type > maxDepth) {
-                        maxDepth = currentMap.regions[regionIdx].type;
-                    }
-                }
-            }
+void MainWindow::compactJournalIfNeeded() {
+    // Con otra tarea en curso se espera: un guardado en marcha ya deja el
+    // diario al día al terminar, y una carga ocupa la barra de progreso
+    if (backgroundTask || !journal.needsCompaction() || currentMapPath.isEmpty()) return;
 
-            // Actualizar profundidad de la región frontal
-            if (maxDepth > currentMap.regions[wall.front_region].type) {
-                currentMap.regions[wall.front_region].type = maxDepth;
-            }
-        }
-    }
+    // Guardado completo periódico en segundo plano, como cualquier otro:
+    // al terminar el diario vuelve a empezar y se rehace el .wldx
+    saveInBackground(currentMapPath, currentMapCompressed, false);
 }
 
-bool MainWindow::isPointInRegion(qreal x, qreal y, const std::vector<QPointF> &polygon) {
-    if (polygon.size() < 3) return false;
-
-    bool inside = false;
-    int j = polygon.size() - 1;
-
-    for (int i = 0; i < polygon.size(); i++) {
-        const QPointF &pi = polygon[i];
-        const QPointF &pj = polygon[j];
-
-        if (((pi.y() > y) != (pj.y() > y)) &&
-            (x < (pj.x() - pi.x()) * (y - pi.y()) / (pj.y() - pi.y()) + pi.x())) {
-            inside = !inside;
-        }
-        j = i;
-    }
-
-    return inside;
+void MainWindow::refreshSidecar(const QString &filename, std::shared_ptr<const ModernMap> snapshot,
+                                const MapSidecar::Key &key) {
+    // El .wldx se regenera en segundo plano. snapshot y key deben venir de los
+    // mismos bytes (los que se guardaron o se leyeron), no de releer el
+    // fichero, que puede haber cambiado entretanto. Si falla simplemente se
+    // recalculará al abrir. Nadie espera el resultado, así que va directo al
+    // pool sin QFuture.
+    QThreadPool::globalInstance()->start([snapshot, filename, key]() {
+        MapSidecar::write(filename, *snapshot, key);
+    });
 }
 
 MainWindow::~MainWindow()
 {
+    if (thumbnailTask) thumbnailTask->cancelled = true;
     delete ui;
 }
@@ -4,10 +4,18 @@
 #include <QMainWindow>
 #include <QGraphicsScene>
 #include "MapStructures.h"
+#include "MapJournal.h"
+#include "MapGeometry.h"
+#include "MapTasks.h"
+#include "MapSidecar.h"
+#include <memory>
 #include "textureselectordialog.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
+class QProgressBar;
+class QTimer;
+class QToolButton;
 QT_END_NAMESPACE
 
 class MainWindow : public QMainWindow
@@ -48,6 +56,27 @@ private:
     // Reemplazar sectores/paredes individuales con mapa moderno
     ModernMap currentMap;
 
+    // Fichero WLD actual y diario de ediciones asociado
+    QString currentMapPath;
+    bool currentMapCompressed = false;
+    MapJournal journal;
+
+    // Aumenta con cada edición: un guardado en segundo plano sabe así si el
+    // mapa cambió desde su copia (con o sin diario abierto)
+    quint64 editGeneration = 0;
+    quint64 mapSession = 0;         // Aumenta al empezar o cargar otro mapa
+
+    // Tarea en segundo plano en curso (guardar/cargar mapa o FPG) y su progreso
+    std::shared_ptr<TaskControl> backgroundTask;
+
+    // Duplicados y miniaturas del FPG: va aparte para no bloquear guardar/cargar
+    std::shared_ptr<TaskControl> thumbnailTask;
+    int thumbnailsShown = 0;
+
+    QProgressBar *taskProgress;
+    QToolButton *taskCancelButton;
+    QTimer *taskTimer;
+
     QVector<QPointF> currentPolygon;
     QVector<QPointF> currentWallPoints;
     int selectedSectorIndex = -1;
@@ -66,17 +95,13 @@ private:
     void updateScene();
     void drawRegion(const ModernRegion &region);
     void drawWall(const ModernWall &wall);
-    void drawWLDMap(bool adjustView = true);
-    void assignRegionsAndPortals();
-    void sortRegionsByDepth();                      // <-- Añadir esta línea
-    bool wallsShareVertices(const ModernWall &w1, const ModernWall &w2);  // <-- Añadir esta línea
-    bool wallsHaveOppositeOrientation(const ModernWall &w1, const ModernWall &w2);  // <-- Añadir esta línea
-    bool isPointInRegion(qreal x, qreal y, const std::vector<QPointF> &polygon);
+    void drawWLDMap(bool adjustView = true, const MapGeometry *precomputed = nullptr);
     void onMouseMoved(QPointF pos);  // <-- Añadir esta línea
     void updateSelectionColors();
 
     // Funciones de archivo
-    bool loadFPGFile(const QString &filename);
+    void loadFPGFile(const QString &filename);
+    void saveTexturesToFPG();
     bool exportToWLD(const QString &filename);
     bool importFromWLD(const QString &filename);
 
@@ -85,6 +110,19 @@ private:
     int findOrCreatePoint(int32_t x, int32_t y);
     void updateTextureThumbnails();
     void forceSyncSectorList();
+    // Con base, el diario nuevo incluye las ediciones de currentMap respecto
+    // a base, que es lo que hay ahora en filename
+    void startJournal(const QString &filename, bool compressed, const ModernMap *base = nullptr);
+    void mapEdited();
+    void compactJournalIfNeeded();
+    void saveInBackground(const QString &filename, bool compressed, bool announce);
+    void refreshSidecar(const QString &filename, std::shared_ptr<const ModernMap> snapshot,
+                        const MapSidecar::Key &key);
+    std::shared_ptr<TaskControl> beginBackgroundTask(const QString &label);
+    void endBackgroundTask();
+    void onMapLoaded(const QString &filename, const MapLoadResult &result);
+    void onFPGLoaded(const QString &filename, const FPGLoadResult &result);
+    void buildThumbnailsInBackground(std::shared_ptr<FPGTextureSource> source);
 };
 
 
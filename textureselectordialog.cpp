@@ -1,4 +1,6 @@
 #include "textureselectordialog.h"
+#include <QPixmap>
+#include <QTimer>
 #include <QVBoxLayout>
 
 TextureSelectorDialog::TextureSelectorDialog(QWidget *parent) : QDialog(parent) {
@@ -12,22 +14,61 @@ TextureSelectorDialog::TextureSelectorDialog(QWidget *parent) : QDialog(parent)
     setLayout(layout);
 
     connect(listWidget, &QListWidget::itemDoubleClicked, this, &TextureSelectorDialog::onItemDoubleClicked);
+
+    // Mismo ritmo que la barra de progreso de la ventana principal
+    thumbnailTimer = new QTimer(this);
+    thumbnailTimer->setInterval(50);
+    connect(thumbnailTimer, &QTimer::timeout, this, &TextureSelectorDialog::refreshThumbnails);
 }
 
-void TextureSelectorDialog::setTextures(const QVector<TextureEntry> &tex) {
+void TextureSelectorDialog::setTextures(const QVector<TextureEntry> &tex,
+                                        std::shared_ptr<TaskControl> task) {
     textures = tex;
+    thumbnailTask = task;
+    thumbnailsShown = -1;
+    pendingRows.clear();
     listWidget->clear();
 
-    for (const TextureEntry &entry : textures) {
+    // Mientras se construyen las pirámides en segundo plano no se decodifica
+    // nada aquí: el hilo de la GUI sólo pone un hueco del mismo tamaño
+    QPixmap placeholder(64, 64);
+    placeholder.fill(Qt::lightGray);
+    const QIcon placeholderIcon(placeholder);
+
+    for (int row = 0; row < textures.size(); row++) {
+        const TextureEntry &entry = textures[row];
         QListWidgetItem *item = new QListWidgetItem();
-        if (!entry.pixmap.isNull()) {
-            QIcon icon(entry.pixmap.scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation));
-            item->setIcon(icon);
+        if (!entry.isNull()) {
+            if (!thumbnailTask || entry.thumbnailReady()) {
+                item->setIcon(QIcon(entry.thumbnail(64)));
+            } else {
+                item->setIcon(placeholderIcon);
+                pendingRows.append(row);
+            }
         }
         item->setText(QString("%1: %2").arg(entry.id).arg(entry.filename));
         item->setData(Qt::UserRole, entry.id);
         listWidget->addItem(item);
     }
+
+    if (pendingRows.isEmpty()) thumbnailTimer->stop();
+    else thumbnailTimer->start();
+}
+
+void TextureSelectorDialog::refreshThumbnails() {
+    // Sólo se revisan los huecos cuando la tarea anuncia miniaturas nuevas
+    const int ready = thumbnailTask->itemsReady;
+    if (ready == thumbnailsShown) return;
+    thumbnailsShown = ready;
+
+    QVector<int> stillPending;
+    for (int row : pendingRows) {
+        const TextureEntry &entry = textures[row];
+        if (entry.thumbnailReady()) listWidget->item(row)->setIcon(QIcon(entry.thumbnail(64)));
+        else stillPending.append(row);
+    }
+    pendingRows = stillPending;
+    if (pendingRows.isEmpty()) thumbnailTimer->stop();
 }
 
 void TextureSelectorDialog::onItemDoubleClicked(QListWidgetItem *item) {
@@ -3,13 +3,21 @@
 
 #include <QDialog>
 #include <QListWidget>
+#include <memory>
 #include "MapStructures.h"
+#include "MapTasks.h"
+
+class QTimer;
 
 class TextureSelectorDialog : public QDialog {
     Q_OBJECT
 public:
     TextureSelectorDialog(QWidget *parent = nullptr);
-    void setTextures(const QVector<TextureEntry> &textures);  // QVector en lugar de std::vector
+
+    // Con thumbnailTask en curso, las texturas cuya pirámide aún no está hecha
+    // muestran un hueco y se rellenan según avanza itemsReady
+    void setTextures(const QVector<TextureEntry> &textures,  // QVector en lugar de std::vector
+                     std::shared_ptr<TaskControl> thumbnailTask = nullptr);
     int selectedTextureId() const { return m_selectedTextureId; }
 
 signals:
@@ -19,9 +27,16 @@ private slots:
     void onItemDoubleClicked(QListWidgetItem *item);
 
 private:
+    void refreshThumbnails();
+
     QListWidget *listWidget;
     QVector<TextureEntry> textures;  // QVector en lugar de std::vector
     int m_selectedTextureId = 0;
+
+    std::shared_ptr<TaskControl> thumbnailTask;
+    int thumbnailsShown = -1;
+    QVector<int> pendingRows;       // Filas que aún muestran el hueco
+    QTimer *thumbnailTimer;
 };
 
 #endif